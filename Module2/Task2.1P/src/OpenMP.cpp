@@ -3,38 +3,32 @@
 #include <chrono>
 #include <thread>
 #include <omp.h>
+#include <string.h>
+#include "../../../common/matrix.h"
+#include "../../../common/matrix_io.h"
+#include "../../../common/matrix_rand.h"
+#include "../../../common/gemm.h"
+#include "../../../common/strassen.h"
 
 #define MAX_EL 20
 
 using namespace std;
 using namespace chrono;
 
-int** create_matrix(int size) {
+Matrix<elem_t> create_matrix(int size, uint64_t seed, uint32_t stream, int threads) {
 
-    int** matrix = 0;
-    matrix = new int*[size];
-
-    for (int r = 0; r < size; r++) {
-        matrix[r] = new int[size];
-        for (int c = 0; c < size; c++) {
-            matrix[r][c] = rand() % MAX_EL;
-        }
-    }
+    // counter-based generator, rows are filled in parallel and the values do
+    // not depend on the thread count
+    Matrix<elem_t> matrix(size, size);
+    omp_set_num_threads(threads);
+    matrix_rand_fill(matrix, seed, stream, 0, MAX_EL);
 
     return matrix;
 }
 
-void clear_matrix(int** matrix, int size) {
+elem_t calc_row_col(const Matrix<elem_t> &matrix_a, const Matrix<elem_t> &matrix_b, int row, int col, int size) {
 
-    for (int r = 0; r < size; r++) {
-        delete [] matrix[r];
-    }
-    delete [] matrix;
-}
-
-int calc_row_col(int** matrix_a, int** matrix_b, int row, int col, int size) {
-
-    int result = 0;
+    elem_t result = 0;
 
     for (int i = 0; i < size; i++) {
         result += matrix_a[row][i] * matrix_b[i][col];
@@ -43,18 +37,12 @@ int calc_row_col(int** matrix_a, int** matrix_b, int row, int col, int size) {
     return result;
 }
 
-int** multiply_matrices(int** matrix_a, int** matrix_b, int size, int threads) {
+Matrix<elem_t> multiply_matrices_naive(const Matrix<elem_t> &matrix_a, const Matrix<elem_t> &matrix_b, int size, int threads) {
 
-    int** result = 0;
-    result = new int*[size];
+    Matrix<elem_t> result(size, size);
 
     omp_set_num_threads(threads);
 
-    #pragma omp parallel for schedule(static, size/threads)
-    for (int r = 0; r < size; r++) {
-        result[r] = new int[size];
-    }
-
     #pragma omp parallel for collapse(2) shared(matrix_a, matrix_b, size) schedule(static, size*size/threads)
     for (int r = 0; r < size; r++) {
         for (int c = 0; c < size; c++) {
@@ -65,63 +53,185 @@ int** multiply_matrices(int** matrix_a, int** matrix_b, int size, int threads) {
     return result;
 }
 
-void print_matrix(int** matrix, char* title, int size, ofstream &file) {
+Matrix<elem_t> multiply_matrices(const Matrix<elem_t> &matrix_a, const Matrix<elem_t> &matrix_b, int size, int threads) {
+
+    // gemm accumulates into the result, so start from zero
+    Matrix<elem_t> result(size, size);
+
+    omp_set_num_threads(threads);
 
-    if (file) {
-        file << title << ":\n";
-        for (int r = 0; r < size; r++) {
-            for (int c = 0; c < size - 1; c++) {
-                file << matrix[r][c] << ",";
-            }
-            file << matrix[r][size - 1] << "\n";
+    // one 2d tile of the result per thread, zeroed by the thread that multiplies
+    // into it, so its pages are first touched where they are written
+    gemm_partition part = gemm_partition_create(size, size, threads);
+
+    #pragma omp parallel for shared(matrix_a, matrix_b, result, part) schedule(static)
+    for (int t = 0; t < gemm_partition_tiles(part); t++) {
+        gemm_range tile = gemm_partition_tile(part, t);
+        for (int r = tile.row_start; r < tile.row_end; r++) {
+            memset(result[r] + tile.col_start, 0, (tile.col_end - tile.col_start) * sizeof(elem_t));
         }
+        gemm_tile(matrix_a, matrix_b, result, tile.row_start, tile.row_end, tile.col_start, tile.col_end);
     }
+
+    return result;
 }
 
-duration<double> run_test(int size, ofstream &file, int threads) {
+Matrix<elem_t> multiply_matrices_strassen(const Matrix<elem_t> &matrix_a, const Matrix<elem_t> &matrix_b, int size, int threads, int crossover) {
+
+    // strassen-winograd recursion as omp tasks, blocked gemm below the crossover
+    Matrix<elem_t> result(size, size);
+
+    omp_set_num_threads(threads);
+
+    strassen(matrix_a, matrix_b, result, crossover);
+
+    return result;
+}
+
+void save_matrix(const Matrix<elem_t> &matrix, const char* title, int matrixFile) {
+
+    // binary record (header + raw rows) written straight from the matrix storage,
+    // tools/mm-convert turns the file back into the old csv text
+    if (matrixFile >= 0 && !write_matrix(matrixFile, matrix, title)) {
+        perror(title);
+    }
+}
+
+struct test_result {
+    duration<double> blocked;
+    duration<double> naive;
+    bool match;
+    duration<double> strassen;
+    bool strassen_match;
+};
+
+test_result run_test(int size, uint64_t seed, int matrixFile, bool dumpInputs, int threads, bool compare, int crossover) {
     
-    int** matrix_a = create_matrix(size);
-    int** matrix_b = create_matrix(size);
+    test_result res = {};
+
+    Matrix<elem_t> matrix_a = create_matrix(size, seed, MATRIX_STREAM_A, threads);
+    Matrix<elem_t> matrix_b = create_matrix(size, seed, MATRIX_STREAM_B, threads);
 
     high_resolution_clock::time_point timeStart = high_resolution_clock::now();
-    int** multiplied = multiply_matrices(matrix_a, matrix_b, size, threads);
+    Matrix<elem_t> multiplied = multiply_matrices(matrix_a, matrix_b, size, threads);
     high_resolution_clock::time_point timeEnd = high_resolution_clock::now();
+    res.blocked = duration_cast<duration<double>>(timeEnd - timeStart);
+
+    // time the original row/col kernel on the same inputs and check the results agree
+    res.match = true;
+    if (compare) {
+        timeStart = high_resolution_clock::now();
+        Matrix<elem_t> reference = multiply_matrices_naive(matrix_a, matrix_b, size, threads);
+        timeEnd = high_resolution_clock::now();
+        res.naive = duration_cast<duration<double>>(timeEnd - timeStart);
+        res.match = (multiplied == reference);
+    }
 
-    print_matrix(matrix_a, (char*)"Matrix A", size, file);
-    print_matrix(matrix_b, (char*)"Matrix B", size, file);
-    print_matrix(multiplied, (char*)"Result", size, file);
+    // time strassen-winograd on the same inputs, it must match the blocked result exactly
+    res.strassen_match = true;
+    if (crossover > 0) {
+        timeStart = high_resolution_clock::now();
+        Matrix<elem_t> fast = multiply_matrices_strassen(matrix_a, matrix_b, size, threads, crossover);
+        timeEnd = high_resolution_clock::now();
+        res.strassen = duration_cast<duration<double>>(timeEnd - timeStart);
+        res.strassen_match = (multiplied == fast);
+    }
 
-    clear_matrix(matrix_a, size);
-    clear_matrix(matrix_b, size);
+    if (dumpInputs) {
+        save_matrix(matrix_a, "Matrix A", matrixFile);
+        save_matrix(matrix_b, "Matrix B", matrixFile);
+    }
+    save_matrix(multiplied, "Result", matrixFile);
 
-    return duration_cast<duration<double>>(timeEnd - timeStart);;
+    return res;
 }
 
-int main(int argc, char** argv) {
+void print_benchmark(int* tests, test_result* results, int numTests, bool compare, int crossover, ostream &out) {
+
+    // strassen gflop/s is effective throughput, counted as 2n^3 like the other columns
+    char line[256];
+    int len;
 
-    srand(time(NULL));
+    out << "Benchmark (GFLOP/s):\n";
+
+    len = snprintf(line, sizeof(line), "%8s", "Size");
+    if (compare) len += snprintf(line + len, sizeof(line) - len, " %12s %10s", "Naive (s)", "GFLOP/s");
+    len += snprintf(line + len, sizeof(line) - len, " %12s %10s", "Blocked (s)", "GFLOP/s");
+    if (compare) len += snprintf(line + len, sizeof(line) - len, " %8s", "Speedup");
+    if (crossover > 0) len += snprintf(line + len, sizeof(line) - len, " %12s %10s %8s", "Strassen (s)", "GFLOP/s", "Speedup");
+    if (compare || crossover > 0) len += snprintf(line + len, sizeof(line) - len, " %6s", "Match");
+    out << line << "\n";
+
+    for (int t = 0; t < numTests; t++) {
+        int n = tests[t];
+        double naive = results[t].naive.count();
+        double blocked = results[t].blocked.count();
+        double fast = results[t].strassen.count();
+
+        len = snprintf(line, sizeof(line), "%8d", n);
+        if (compare) len += snprintf(line + len, sizeof(line) - len, " %12.4f %10.3f", naive, gemm_gflops(n, naive));
+        len += snprintf(line + len, sizeof(line) - len, " %12.4f %10.3f", blocked, gemm_gflops(n, blocked));
+        if (compare) len += snprintf(line + len, sizeof(line) - len, " %7.1fx", naive / blocked);
+        if (crossover > 0) len += snprintf(line + len, sizeof(line) - len, " %12.4f %10.3f %7.2fx", fast, gemm_gflops(n, fast), blocked / fast);
+        if (compare || crossover > 0) len += snprintf(line + len, sizeof(line) - len, " %6s", results[t].match && results[t].strassen_match ? "yes" : "NO");
+        out << line << "\n";
+    }
+    out << "\n";
+}
+
+int main(int argc, char** argv) {
 
     int threads = 0;
-    // set number of threads
-    if (argc > 1) threads = atoi(argv[0]);
+    // set number of threads, --compare also times the original calc_row_col kernel,
+    // --strassen also times strassen-winograd, --crossover N sets its cutoff (implies --strassen)
+    // --no-inputs writes only the result matrices to the .mat file, not a and b
+    // --seed N regenerates the same inputs as an earlier run (printed as "Seed:")
+    bool compare = false;
+    bool dumpInputs = true;
+    uint64_t seed = matrix_rand_seed();
+    int crossover = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--compare") == 0) compare = true;
+        else if (strcmp(argv[i], "--no-inputs") == 0) dumpInputs = false;
+        else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) seed = strtoull(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "--strassen") == 0 && crossover == 0) crossover = STRASSEN_CROSSOVER;
+        else if (strcmp(argv[i], "--crossover") == 0 && i + 1 < argc) crossover = atoi(argv[++i]);
+        else threads = atoi(argv[i]);
+    }
     // if no arg or invalid arg, set default threads = cores
     if (threads < 1) threads = thread::hardware_concurrency();
 
     ofstream file;
     file.open("OpenMP.txt");
 
+    int matrixFile = open_matrix_file("OpenMP.mat");
+    if (matrixFile < 0) perror("OpenMP.mat");
+
+    file << "Seed:\t" << seed << "\n\n";
+
+    cout << "Kernel: " << gemm_isa_name(gemm_isa()) << endl;
+    cout << "Seed: " << seed << endl;
+    if (crossover > 0) cout << "Strassen crossover: " << crossover << endl;
+    cout << endl;
+
     int tests[] = {100, 500, 1000, 2500, 5000};
     duration<double> testDuration;
 
     int numTests = sizeof(tests) / sizeof(tests[0]);
+    test_result results[numTests];
     for (int t = 0; t < numTests; t++) {
         file << "Test " << t << "\n";
-        testDuration = run_test(tests[t], file, threads);
+        results[t] = run_test(tests[t], seed, matrixFile, dumpInputs, threads, compare, crossover);
+        testDuration = results[t].blocked;
         file << "Input Size:\t" << tests[t] << "\nElapsed Time:\t" << testDuration.count() << "\n\n";
         cout << "Input Size:\t" << tests[t] << "\nElapsed Time:\t" << testDuration.count() << "\n\n";
     }
 
+    print_benchmark(tests, results, numTests, compare, crossover, file);
+    print_benchmark(tests, results, numTests, compare, crossover, cout);
+
     file.close();
+    if (matrixFile >= 0) close(matrixFile);
 
     return 0;
 }
\ No newline at end of file
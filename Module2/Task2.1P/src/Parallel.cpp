@@ -3,46 +3,60 @@
 #include <chrono>
 #include <pthread.h>
 #include <thread>
+#include <string.h>
+#include "../../../common/matrix.h"
+#include "../../../common/matrix_io.h"
+#include "../../../common/matrix_rand.h"
+#include "../../../common/gemm.h"
+#include "../../../common/strassen.h"
+#include "../../../common/thread_pool.h"
 
 #define MAX_EL 20
-#define MAX_THREADS 2
+#define TILE_SIZE 256
 
 using namespace std;
 using namespace chrono;
 
 struct worker_args {
-    int** matrix_a;
-    int** matrix_b;
-    int** result;
+    const Matrix<elem_t>* matrix_a;
+    const Matrix<elem_t>* matrix_b;
+    Matrix<elem_t>* result;
     int el_start, el_end, size;
 };
 
-int** create_matrix(int size) {
+struct tile_args {
+    const Matrix<elem_t>* matrix_a;
+    const Matrix<elem_t>* matrix_b;
+    Matrix<elem_t>* result;
+};
 
-    int** matrix = 0;
-    matrix = new int*[size];
+struct rand_args {
+    Matrix<elem_t>* matrix;
+    uint64_t seed;
+    uint32_t stream;
+};
 
-    for (int r = 0; r < size; r++) {
-        matrix[r] = new int[size];
-        for (int c = 0; c < size; c++) {
-            matrix[r][c] = rand() % MAX_EL;
-        }
-    }
+void rand_worker(const tile_t &tile, void* ctx) {
 
-    return matrix;
+    struct rand_args* args = (struct rand_args*)ctx;
+
+    matrix_rand_rows(*args->matrix, args->seed, args->stream, 0, 0, tile.row_start, tile.row_end, MAX_EL);
 }
 
-void clear_matrix(int** matrix, int size) {
+Matrix<elem_t> create_matrix(int size, uint64_t seed, uint32_t stream, thread_pool &pool, int tileSize) {
 
-    for (int r = 0; r < size; r++) {
-        delete [] matrix[r];
-    }
-    delete [] matrix;
+    // counter-based generator, row blocks are filled on the pool (which also
+    // first-touches the pages) and the values do not depend on the thread count
+    Matrix<elem_t> matrix(size, size);
+    struct rand_args args = {&matrix, seed, stream};
+    pool.run(make_tiles(size, size, tileSize, size), &rand_worker, &args);
+
+    return matrix;
 }
 
-int calc_row_col(int** matrix_a, int** matrix_b, int row, int col, int size) {
+elem_t calc_row_col(const Matrix<elem_t> &matrix_a, const Matrix<elem_t> &matrix_b, int row, int col, int size) {
 
-    int result = 0;
+    elem_t result = 0;
 
     for (int i = 0; i < size; i++) {
         result += matrix_a[row][i] * matrix_b[i][col];
@@ -51,31 +65,29 @@ int calc_row_col(int** matrix_a, int** matrix_b, int row, int col, int size) {
     return result;
 }
 
-void* worker(void* arg) {
+void* naive_worker(void* arg) {
     
     struct worker_args* args = (struct worker_args*)arg;
 
     for (int el = args->el_start; el <= args->el_end; el++) {
         int row = el / args->size;
         int col = el % args->size;
-        args->result[row][col] = calc_row_col(args->matrix_a, args->matrix_b, row, col, args->size);
+        (*args->result)[row][col] = calc_row_col(*args->matrix_a, *args->matrix_b, row, col, args->size);
     }
 
     free(arg);
+    return NULL;
 }
 
-int** multiply_matrices(int** matrix_a, int** matrix_b, int size) {
+Matrix<elem_t> multiply_matrices_naive(const Matrix<elem_t> &matrix_a, const Matrix<elem_t> &matrix_b, int size, int maxThreads) {
 
     // create matrix to store result
-    int** result = new int*[size];
-    for (int r = 0; r < size; r++) {
-        result[r] = new int[size];
-    }
+    Matrix<elem_t> result(size, size);
 
     // calculate data partitioning based on threads
     int elCount = size * size;
-    int threadCount = MAX_THREADS;
-    if (MAX_THREADS > elCount) threadCount = elCount;
+    int threadCount = maxThreads;
+    if (maxThreads > elCount) threadCount = elCount;
     int elPart = elCount / threadCount;
 
     // create array to store thread refs
@@ -85,15 +97,15 @@ int** multiply_matrices(int** matrix_a, int** matrix_b, int size) {
     for (int t = 0; t < (threadCount); t++) {
         
         struct worker_args* args = (struct worker_args*)malloc(sizeof(struct worker_args));
-        args->matrix_a = matrix_a;
-        args->matrix_b = matrix_b;
-        args->result = result;
+        args->matrix_a = &matrix_a;
+        args->matrix_b = &matrix_b;
+        args->result = &result;
         args->el_start = t * elPart;
         args->el_end = args->el_start + elPart - 1;
-        if (args->el_end > elCount - 1) args->el_end = elCount -1;
+        if (args->el_end > elCount - 1 || t == threadCount - 1) args->el_end = elCount -1;
         args->size = size;
 
-        pthread_create(&threads[t], NULL, &worker, args);
+        pthread_create(&threads[t], NULL, &naive_worker, args);
     }
 
     // wait for worker threads to finish
@@ -104,61 +116,214 @@ int** multiply_matrices(int** matrix_a, int** matrix_b, int size) {
     return result;
 }
 
-void print_matrix(int** &matrix, char* title, int size, ofstream &file) {
+void tile_worker(const tile_t &tile, void* ctx) {
+
+    struct tile_args* args = (struct tile_args*)ctx;
+
+    gemm_tile(*args->matrix_a, *args->matrix_b, *args->result, tile.row_start, tile.row_end, tile.col_start, tile.col_end);
+}
+
+Matrix<elem_t> multiply_matrices(const Matrix<elem_t> &matrix_a, const Matrix<elem_t> &matrix_b, int size,
+                                 thread_pool &pool, int tileSize) {
+
+    // create zeroed matrix to store result, gemm accumulates into it
+    Matrix<elem_t> result(size, size);
+    result.fill(0);
 
-    if (file) {
-        file << title << ":\n";
-        for (int r = 0; r < size; r++) {
-            for (int c = 1; c < size - 1; c++) {
-                file << matrix[r][c] << ",";
-            }
-            file << matrix[r][size - 2] << "\n";
-        }
+    // split the output into 2d tiles, idle workers steal tiles from busy ones
+    struct tile_args args = {&matrix_a, &matrix_b, &result};
+    pool.run(make_tiles(size, size, tileSize, tileSize), &tile_worker, &args);
+
+    return result;
+}
+
+Matrix<elem_t> multiply_matrices_strassen(const Matrix<elem_t> &matrix_a, const Matrix<elem_t> &matrix_b, int size, int crossover) {
+
+    // strassen-winograd recursion as omp tasks, blocked gemm below the crossover
+    Matrix<elem_t> result(size, size);
+    strassen(matrix_a, matrix_b, result, crossover);
+
+    return result;
+}
+
+void save_matrix(const Matrix<elem_t> &matrix, const char* title, int matrixFile) {
+
+    // binary record (header + raw rows) written straight from the matrix storage,
+    // tools/mm-convert turns the file back into the old csv text
+    if (matrixFile >= 0 && !write_matrix(matrixFile, matrix, title)) {
+        perror(title);
     }
 }
 
-duration<double> run_test(int size, ofstream &file) {
+void print_pool_stats(const thread_pool &pool, ostream &out) {
+
+    char line[128];
+
+    out << "Worker Utilisation:\n";
+    snprintf(line, sizeof(line), "%8s %8s %8s %10s %8s\n", "Worker", "Tiles", "Stolen", "Busy (s)", "Util");
+    out << line;
+
+    for (int w = 0; w < pool.size(); w++) {
+        const worker_stats_t &st = pool.stats(w);
+        double util = pool.wall() > 0 ? 100.0 * st.busy / pool.wall() : 0;
+        snprintf(line, sizeof(line), "%8d %8ld %8ld %10.4f %7.1f%%\n", w, st.tiles, st.stolen, st.busy, util);
+        out << line;
+    }
+    out << "\n";
+}
+
+struct test_result {
+    duration<double> blocked;
+    duration<double> naive;
+    bool match;
+    duration<double> strassen;
+    bool strassen_match;
+};
+
+test_result run_test(int size, uint64_t seed, ofstream &file, int matrixFile, bool dumpInputs, thread_pool &pool, int tileSize, bool compare, int crossover) {
     
-    int** matrix_a = create_matrix(size);
-    int** matrix_b = create_matrix(size);
+    test_result res = {};
+
+    Matrix<elem_t> matrix_a = create_matrix(size, seed, MATRIX_STREAM_A, pool, tileSize);
+    Matrix<elem_t> matrix_b = create_matrix(size, seed, MATRIX_STREAM_B, pool, tileSize);
+
+    pool.reset_stats();
 
     high_resolution_clock::time_point timeStart = high_resolution_clock::now();
-    int** multiplied = multiply_matrices(matrix_a, matrix_b, size);
+    Matrix<elem_t> multiplied = multiply_matrices(matrix_a, matrix_b, size, pool, tileSize);
     high_resolution_clock::time_point timeEnd = high_resolution_clock::now();
+    res.blocked = duration_cast<duration<double>>(timeEnd - timeStart);
+
+    // time the original row/col kernel on the same inputs and check the results agree
+    res.match = true;
+    if (compare) {
+        timeStart = high_resolution_clock::now();
+        Matrix<elem_t> reference = multiply_matrices_naive(matrix_a, matrix_b, size, pool.size());
+        timeEnd = high_resolution_clock::now();
+        res.naive = duration_cast<duration<double>>(timeEnd - timeStart);
+        res.match = (multiplied == reference);
+    }
+
+    // time strassen-winograd on the same inputs, it must match the blocked result exactly
+    res.strassen_match = true;
+    if (crossover > 0) {
+        timeStart = high_resolution_clock::now();
+        Matrix<elem_t> fast = multiply_matrices_strassen(matrix_a, matrix_b, size, crossover);
+        timeEnd = high_resolution_clock::now();
+        res.strassen = duration_cast<duration<double>>(timeEnd - timeStart);
+        res.strassen_match = (multiplied == fast);
+    }
+
+    if (dumpInputs) {
+        save_matrix(matrix_a, "Matrix A", matrixFile);
+        save_matrix(matrix_b, "Matrix B", matrixFile);
+    }
+    save_matrix(multiplied, "Result", matrixFile);
+
+    print_pool_stats(pool, file);
+    print_pool_stats(pool, cout);
 
-    print_matrix(matrix_a, (char*)"Matrix A", size, file);
-    print_matrix(matrix_b, (char*)"Matrix B", size, file);
-    print_matrix(multiplied, (char*)"Result", size, file);
+    return res;
+}
+
+void print_benchmark(int* tests, test_result* results, int numTests, bool compare, int crossover, ostream &out) {
+
+    // strassen gflop/s is effective throughput, counted as 2n^3 like the other columns
+    char line[256];
+    int len;
+
+    out << "Benchmark (GFLOP/s):\n";
 
-    clear_matrix(matrix_a, size);
-    clear_matrix(matrix_b, size);
+    len = snprintf(line, sizeof(line), "%8s", "Size");
+    if (compare) len += snprintf(line + len, sizeof(line) - len, " %12s %10s", "Naive (s)", "GFLOP/s");
+    len += snprintf(line + len, sizeof(line) - len, " %12s %10s", "Blocked (s)", "GFLOP/s");
+    if (compare) len += snprintf(line + len, sizeof(line) - len, " %8s", "Speedup");
+    if (crossover > 0) len += snprintf(line + len, sizeof(line) - len, " %12s %10s %8s", "Strassen (s)", "GFLOP/s", "Speedup");
+    if (compare || crossover > 0) len += snprintf(line + len, sizeof(line) - len, " %6s", "Match");
+    out << line << "\n";
 
-    return duration_cast<duration<double>>(timeEnd - timeStart);;
+    for (int t = 0; t < numTests; t++) {
+        int n = tests[t];
+        double naive = results[t].naive.count();
+        double blocked = results[t].blocked.count();
+        double fast = results[t].strassen.count();
+
+        len = snprintf(line, sizeof(line), "%8d", n);
+        if (compare) len += snprintf(line + len, sizeof(line) - len, " %12.4f %10.3f", naive, gemm_gflops(n, naive));
+        len += snprintf(line + len, sizeof(line) - len, " %12.4f %10.3f", blocked, gemm_gflops(n, blocked));
+        if (compare) len += snprintf(line + len, sizeof(line) - len, " %7.1fx", naive / blocked);
+        if (crossover > 0) len += snprintf(line + len, sizeof(line) - len, " %12.4f %10.3f %7.2fx", fast, gemm_gflops(n, fast), blocked / fast);
+        if (compare || crossover > 0) len += snprintf(line + len, sizeof(line) - len, " %6s", results[t].match && results[t].strassen_match ? "yes" : "NO");
+        out << line << "\n";
+    }
+    out << "\n";
 }
 
-int main() {
+int main(int argc, char** argv) {
+
+    // --compare also times the original calc_row_col kernel for the benchmark table
+    // --strassen also times strassen-winograd, --crossover N sets its cutoff (implies --strassen)
+    // --no-inputs writes only the result matrices to the .mat file, not a and b
+    // --seed N regenerates the same inputs as an earlier run (printed as "Seed:")
+    // --threads N sets the pool size (default cores), --tile N the output tile edge
+    bool compare = false;
+    bool dumpInputs = true;
+    uint64_t seed = matrix_rand_seed();
+    int crossover = 0;
+    int threads = 0;
+    int tileSize = TILE_SIZE;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--compare") == 0) compare = true;
+        else if (strcmp(argv[i], "--no-inputs") == 0) dumpInputs = false;
+        else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) seed = strtoull(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "--strassen") == 0 && crossover == 0) crossover = STRASSEN_CROSSOVER;
+        else if (strcmp(argv[i], "--crossover") == 0 && i + 1 < argc) crossover = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) threads = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--tile") == 0 && i + 1 < argc) tileSize = atoi(argv[++i]);
+    }
 
-    srand(time(NULL));
+    int cores = thread::hardware_concurrency();
+    if (threads < 1) threads = cores;
+    if (threads < 1) threads = 1;
+    if (tileSize < 1) tileSize = TILE_SIZE;
+
+    // workers are created once and reused by every test
+    thread_pool pool(threads);
 
     ofstream file;
     file.open("Parallel.txt");
 
+    int matrixFile = open_matrix_file("Parallel.mat");
+    if (matrixFile < 0) perror("Parallel.mat");
+
+    file << "Seed:\t" << seed << "\n\n";
+
     int tests[] = {100, 500, 1000, 2500, 5000};
     duration<double> testDuration;
 
-    int cores = thread::hardware_concurrency();
     cout << "Cores: " << cores << endl;
-    cout << "Max threads: " << MAX_THREADS << endl << endl;
+    cout << "Threads: " << pool.size() << endl;
+    cout << "Tile size: " << tileSize << endl;
+    cout << "Kernel: " << gemm_isa_name(gemm_isa()) << endl;
+    cout << "Seed: " << seed << endl;
+    if (crossover > 0) cout << "Strassen crossover: " << crossover << endl;
+    cout << endl;
 
     int numTests = sizeof(tests) / sizeof(tests[0]);
+    test_result results[numTests];
     for (int t = 0; t < numTests; t++) {
         file << "Test " << t << "\n";
-        testDuration = run_test(tests[t], file);
+        results[t] = run_test(tests[t], seed, file, matrixFile, dumpInputs, pool, tileSize, compare, crossover);
+        testDuration = results[t].blocked;
         file << "Input Size:\t" << tests[t] << "\nElapsed Time:\t" << testDuration.count() << "\n\n";
         cout << "Input Size:\t" << tests[t] << "\nElapsed Time:\t" << testDuration.count() << "\n\n";
     }
 
+    print_benchmark(tests, results, numTests, compare, crossover, file);
+    print_benchmark(tests, results, numTests, compare, crossover, cout);
+
     file.close();
+    if (matrixFile >= 0) close(matrixFile);
 
     return 0;
 }
\ No newline at end of file
@@ -1,9 +1,13 @@
 #include <iostream>
 #include <stdlib.h>
+#include <string.h>
 #include <chrono>
 #include <pthread.h>
 #include <thread>
 #include <omp.h>
+#include "../../../common/introsort.h"
+#include "../../../common/radix_sort.h"
+#include "../../../common/sort_verify.h"
 
 #define NUM_ELEMENTS 500000000
 #define MAX_ELEMENT 10000000
@@ -11,82 +15,67 @@
 using namespace std;
 using namespace chrono;
 
-void swap(int &a, int &b) 
-{ 
-    int t = a; 
-    a = b; 
-    b = t; 
-}
-
-int partition(int* arr, int low, int high) 
-{ 
-    int pivot = arr[high];
-    int i = (low - 1);
-  
-    for (int j = low; j <= high- 1; j++) 
-    { 
-        if (arr[j] <= pivot) 
-        { 
-            i++;
-            swap(arr[i], arr[j]); 
-        } 
-    }
-
-    swap(arr[i + 1], arr[high]);
-    return (i + 1); 
-} 
-
-void quicksort(int* arr, int low, int high) 
-{
-    if (low < high) 
-    {
-        int pi = partition(arr, low, high);
-
-        if ((high - low) < 5000) {
-            quicksort(arr, low, pi - 1); 
-            quicksort(arr, pi + 1, high); 
-        }
-        else {
-            #pragma omp task
-            {
-                quicksort(arr, low, pi - 1); 
-            }
-            #pragma omp task
-            {
-                quicksort(arr, pi + 1, high);
-            }
-        }
-    }
-} 
-
-int main() {
+int main(int argc, char **argv) {
 
     // seed random from current time
     srand(time(NULL));
     
     int threads = 4;
 
-    // generate random array
+    // --radix sorts data with the radix backend, and a copy with quicksort for comparison
+    bool radix = false;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--radix") == 0) radix = true;
+    }
+
+    // generate random array, with its order-independent hash for the permutation check
     int* data = (int*)calloc(NUM_ELEMENTS, sizeof(int));
+    uint64_t inputHash = 0;
     for (int i = 0; i < NUM_ELEMENTS; i++) {
         data[i] = rand() % (MAX_ELEMENT - 1) + 1;
+        inputHash += sort_key_hash(data[i]);
     }
     
-    omp_set_num_threads(4);
+    omp_set_num_threads(threads);
 
-    high_resolution_clock::time_point timeStart = high_resolution_clock::now();
-    #pragma omp parallel
-    {
-        #pragma omp single nowait
-        {
-            quicksort(data, 0, NUM_ELEMENTS - 1);
+    int* quick = data;
+    if (radix) {
+        quick = (int*)malloc(NUM_ELEMENTS * sizeof(int));
+        if (quick == NULL) {
+            perror("Failed to allocate comparison array. Exiting...\n");
+            exit(1);
         }
+        memcpy(quick, data, NUM_ELEMENTS * sizeof(int));
     }
+
+    high_resolution_clock::time_point timeStart = high_resolution_clock::now();
+    // the top levels are partitioned by every thread, the rest split between them
+    parallel_introsort(quick, NUM_ELEMENTS, threads);
     high_resolution_clock::time_point timeEnd = high_resolution_clock::now();
 
     duration<double> testDuration = duration_cast<duration<double>>(timeEnd - timeStart);
     cout << "Sort completed in " << testDuration.count() << " seconds." << endl;
 
+    // every adjacent pair in order, and the same keys as the input
+    high_resolution_clock::time_point verifyStart = high_resolution_clock::now();
+    bool valid = sort_verify(quick, NUM_ELEMENTS, inputHash, threads);
+    duration<double> verifyDuration = duration_cast<duration<double>>(high_resolution_clock::now() - verifyStart);
+    cout << "Validity Test (" << NUM_ELEMENTS << " elements, order and multiset hash): " << (valid ? "PASS" : "FAIL") << endl;
+    cout << "Verify Time: " << verifyDuration.count() << " seconds (" << 100 * verifyDuration.count() / testDuration.count() << "% of sort)." << endl;
+
+    if (radix) {
+        timeStart = high_resolution_clock::now();
+        int passes = radix_sort(data, NUM_ELEMENTS, threads);
+        timeEnd = high_resolution_clock::now();
+
+        duration<double> radixDuration = duration_cast<duration<double>>(timeEnd - timeStart);
+        bool match = memcmp(data, quick, NUM_ELEMENTS * sizeof(int)) == 0 && sort_verify(data, NUM_ELEMENTS, inputHash, threads);
+        cout << "Radix sort completed in " << radixDuration.count() << " seconds (" << passes << " passes)." << endl;
+        cout << "Radix Speedup: " << testDuration.count() / radixDuration.count() << endl;
+        cout << "Results Match: " << (match ? "PASS" : "FAIL") << endl;
+        free(quick);
+    }
+
     /*for (int i = 0; i < NUM_ELEMENTS; i++) {
         cout << data[i] << " ";
     }
@@ -3,6 +3,8 @@
 #include <stdlib.h>
 #include <chrono>
 #include <pthread.h>
+#include "../../../common/introsort.h"
+#include "../../../common/sort_verify.h"
 
 #define NUM_ELEMENTS 500000000
 #define MAX_ELEMENT 10000000
@@ -10,59 +12,33 @@
 using namespace std;
 using namespace chrono;
 
-void swap(int &a, int &b) 
-{ 
-    int t = a; 
-    a = b; 
-    b = t; 
-}
-
-int partition(int* arr, int low, int high) 
-{ 
-    int pivot = arr[high];
-    int i = (low - 1);
-  
-    for (int j = low; j <= high- 1; j++) 
-    { 
-        if (arr[j] <= pivot) 
-        { 
-            i++;
-            swap(arr[i], arr[j]); 
-        } 
-    }
-
-    swap(arr[i + 1], arr[high]);
-    return (i + 1); 
-} 
-
-void quickSort(int* arr, int low, int high) 
-{
-    if (low < high) 
-    {
-        int pi = partition(arr, low, high); 
-        quickSort(arr, low, pi - 1); 
-        quickSort(arr, pi + 1, high); 
-    }
-} 
-
 int main() {
 
     // seed random from current time
     srand(time(NULL));
 
-    // generate random array
+    // generate random array, with its order-independent hash for the permutation check
     int* data = (int*)calloc(NUM_ELEMENTS, sizeof(int));
+    uint64_t inputHash = 0;
     for (int i = 0; i < NUM_ELEMENTS; i++) {
         data[i] = rand() % (MAX_ELEMENT - 1) + 1;
+        inputHash += sort_key_hash(data[i]);
     }
     
     high_resolution_clock::time_point timeStart = high_resolution_clock::now();
-    quickSort(data, 0, NUM_ELEMENTS - 1);
+    introsort(data, 0, NUM_ELEMENTS - 1);
     high_resolution_clock::time_point timeEnd = high_resolution_clock::now();
 
     duration<double> testDuration = duration_cast<duration<double>>(timeEnd - timeStart);
     cout << "Sort completed in " << testDuration.count() << " seconds." << endl;
 
+    // every adjacent pair in order, and the same keys as the input
+    high_resolution_clock::time_point verifyStart = high_resolution_clock::now();
+    bool valid = sort_verify(data, NUM_ELEMENTS, inputHash, 1);
+    duration<double> verifyDuration = duration_cast<duration<double>>(high_resolution_clock::now() - verifyStart);
+    cout << "Validity Test (" << NUM_ELEMENTS << " elements, order and multiset hash): " << (valid ? "PASS" : "FAIL") << endl;
+    cout << "Verify Time: " << verifyDuration.count() << " seconds (" << 100 * verifyDuration.count() / testDuration.count() << "% of sort)." << endl;
+
     /*for (int i = 0; i < NUM_ELEMENTS; i++) {
         cout << data[i] << " ";
     }
@@ -0,0 +1,259 @@
+#include <iostream>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include <random>
+#include "../trafficSimulator/traffic_index.h"
+
+#define DEFAULT_LIGHTS 10000
+#define DEFAULT_HOURS 8760  // a year
+#define DEFAULT_TOP 5
+#define MAX_CARS 100
+
+// records the linear-scan baseline is run on
+#define BASELINE_RECORDS 200000
+
+// hours of the stream in the consumer scaling table, and records per batch
+#define SCALE_HOURS 720     // a month
+#define SCALE_BATCH 256
+
+using namespace std;
+using namespace chrono;
+
+// Cost per record of the simulator's hour/light aggregation: traffic_index
+// against the linear scans it replaced (a scan of the hours comparing struct
+// tm, then a scan of that hour's lights). Every light reports once an hour,
+// in a shuffled order. The baseline is O(hours x lights) per record, so it is
+// only run on the first hours of the stream, and the index is timed on the
+// same slice for comparison.
+//
+// The scaling table runs 1 to N consumer threads over the first month of the
+// stream, taking batches from a shared counter as they would from the
+// buffer: once with one table behind a lock taken per batch, once with a
+// table per consumer merged at the end (merge time included).
+//
+// usage: aggregationBenchmark [lights] [hours] [top] [consumers]
+
+struct record_t {
+    int id, cars;
+    long ts;
+};
+
+// the aggregation as it was before traffic_index
+struct scan_light_t {
+    int id, total;
+};
+
+struct scan_hour_t {
+    struct tm timeinfo;
+    vector<scan_light_t> lights;
+};
+
+bool operator==(const tm& a, const tm& b) {
+    return (
+        a.tm_year == b.tm_year &&
+        a.tm_mon == b.tm_mon &&
+        a.tm_mday == b.tm_mday &&
+        a.tm_hour == b.tm_hour
+    );
+}
+
+void scan_add(vector<scan_hour_t> &hours, const record_t &data) {
+
+    time_t rawtime = static_cast<time_t>(data.ts);
+    struct tm timeinfo;
+    localtime_r(&rawtime, &timeinfo);
+    timeinfo.tm_min = 0;
+    timeinfo.tm_sec = 0;
+
+    int hr = -1;
+    for (int i = 0; i < (int)hours.size(); i++) {
+        if (hours[i].timeinfo == timeinfo) {
+            hr = i;
+            break;
+        }
+    }
+    if (hr == -1) {
+        scan_hour_t h;
+        h.timeinfo = timeinfo;
+        hours.push_back(h);
+        hr = hours.size() - 1;
+    }
+
+    int lt = -1;
+    for (int i = 0; i < (int)hours[hr].lights.size(); i++) {
+        if (hours[hr].lights[i].id == data.id) {
+            lt = i;
+            break;
+        }
+    }
+    if (lt == -1) {
+        hours[hr].lights.push_back({data.id, 0});
+        lt = hours[hr].lights.size() - 1;
+    }
+
+    hours[hr].lights[lt].total += data.cars;
+}
+
+// record i of the stream: hour i / lights, lights in a fixed shuffled order
+struct stream_t {
+    vector<int> ids;
+    long start;
+
+    record_t at(long i) const {
+        int lights = ids.size();
+        long hour = i / lights;
+        int light = i % lights;
+        unsigned long z = (i + 1) * 0x9e3779b97f4a7c15ul;
+        record_t r = {ids[light], (int)((z >> 33) % MAX_CARS), start + hour * 3600 + (light % 12) * 300};
+        return r;
+    }
+};
+
+double seconds_since(high_resolution_clock::time_point start) {
+    return duration_cast<duration<double>>(high_resolution_clock::now() - start).count();
+}
+
+// aggregate records [0, records) with consumers threads, into one locked
+// table or into one table each. returns seconds, the final merge in *merge.
+double run_consumers(const stream_t &stream, long records, int consumers, bool local, double* merge, long* cars) {
+
+    traffic_index shared;
+    mutex shared_lock;
+    vector<traffic_index> partial(local ? consumers : 0);
+    atomic<long> next(0);
+    vector<thread> threads;
+
+    high_resolution_clock::time_point start = high_resolution_clock::now();
+    for (int c = 0; c < consumers; c++) {
+        threads.emplace_back([&, c]() {
+            vector<record_t> batch(SCALE_BATCH);
+            long first;
+            while ((first = next.fetch_add(SCALE_BATCH)) < records) {
+                int n = min((long)SCALE_BATCH, records - first);
+                for (int i = 0; i < n; i++) batch[i] = stream.at(first + i);
+
+                if (local) {
+                    for (int i = 0; i < n; i++) partial[c].add(batch[i].id, batch[i].ts, batch[i].cars);
+                }
+                else {
+                    lock_guard<mutex> guard(shared_lock);
+                    for (int i = 0; i < n; i++) shared.add(batch[i].id, batch[i].ts, batch[i].cars);
+                }
+            }
+        });
+    }
+    for (thread &t : threads) t.join();
+
+    high_resolution_clock::time_point merged = high_resolution_clock::now();
+    for (traffic_index &p : partial) shared.merge(p);
+    *merge = seconds_since(merged);
+
+    *cars = 0;
+    for (int hr = 0; hr < shared.hours(); hr++) *cars += shared.cars(hr);
+    return seconds_since(start);
+}
+
+int main(int argc, char** argv) {
+
+    int lights = DEFAULT_LIGHTS;
+    int hours = DEFAULT_HOURS;
+    int top = DEFAULT_TOP;
+    int consumers = max((int)thread::hardware_concurrency(), 1);
+    if (argc > 1) lights = atoi(argv[1]);
+    if (argc > 2) hours = atoi(argv[2]);
+    if (argc > 3) top = atoi(argv[3]);
+    if (argc > 4) consumers = atoi(argv[4]);
+    if (consumers < 1) consumers = 1;
+    if (lights < 1) lights = 1;
+    if (hours < 1) hours = 1;
+    if (top < 1) top = 1;
+
+    stream_t stream;
+    stream.start = 1556434800;  // on the hour
+    stream.ids.resize(lights);
+    for (int i = 0; i < lights; i++) stream.ids[i] = i;
+    shuffle(stream.ids.begin(), stream.ids.end(), mt19937(1));
+
+    long records = (long)lights * hours;
+    printf("%d lights x %d hours = %ld records\n\n", lights, hours, records);
+
+    // baseline slice
+    long slice = min(records, max((long)BASELINE_RECORDS / lights, 1L) * lights);
+    {
+        vector<scan_hour_t> scan;
+        high_resolution_clock::time_point start = high_resolution_clock::now();
+        for (long i = 0; i < slice; i++) scan_add(scan, stream.at(i));
+        double scan_time = seconds_since(start);
+
+        traffic_index index;
+        start = high_resolution_clock::now();
+        for (long i = 0; i < slice; i++) {
+            record_t r = stream.at(i);
+            index.add(r.id, r.ts, r.cars);
+        }
+        double index_time = seconds_since(start);
+
+        printf("First %ld records (%ld hours):\n", slice, slice / lights);
+        printf("Linear Scan: %.1f ns/record\n", scan_time * 1e9 / slice);
+        printf("Index:       %.1f ns/record\n", index_time * 1e9 / slice);
+        printf("Speedup:     %.1fx\n\n", scan_time / index_time);
+    }
+
+    // the whole stream
+    traffic_index index;
+    long cars = 0;
+    high_resolution_clock::time_point start = high_resolution_clock::now();
+    for (long i = 0; i < records; i++) {
+        record_t r = stream.at(i);
+        index.add(r.id, r.ts, r.cars);
+        cars += r.cars;
+    }
+    double index_time = seconds_since(start);
+
+    start = high_resolution_clock::now();
+    vector<light_t> topN;
+    long checksum = 0;
+    for (int hr : index.hour_order()) {
+        index.top(hr, top, topN);
+        checksum += topN[0].total;
+    }
+    double top_time = seconds_since(start);
+
+    // every car counted once
+    long total = 0;
+    for (int hr = 0; hr < index.hours(); hr++) total += index.cars(hr);
+
+    printf("All %ld records:\n", records);
+    printf("Index:       %.1f ns/record, %.2f seconds\n", index_time * 1e9 / records, index_time);
+    printf("Top %d:       %.3f seconds for %d hours (busiest lights sum %ld)\n", top, top_time, index.hours(), checksum);
+    printf("Table Size:  %.1f MB\n", (double)index.hours() * index.lights() * sizeof(int) / (1 << 20));
+    printf("Totals Match: %s\n\n", total == cars ? "PASS" : "FAIL");
+
+    // consumer scaling
+    long scale_records = (long)lights * min(hours, SCALE_HOURS);
+    printf("Consumer scaling, %ld records, %u hardware threads:\n", scale_records, thread::hardware_concurrency());
+    printf("%9s %14s %14s %10s %9s\n", "consumers", "locked rec/s", "local rec/s", "merge s", "speedup");
+
+    double base = 0;
+    bool match = true;
+    for (int c = 1; c <= consumers; c++) {
+        double merge, unused;
+        long locked_cars, local_cars;
+        double locked = run_consumers(stream, scale_records, c, false, &unused, &locked_cars);
+        double local = run_consumers(stream, scale_records, c, true, &merge, &local_cars);
+        if (c == 1) base = local;
+        if (locked_cars != local_cars) match = false;
+
+        printf("%9d %14.0f %14.0f %10.3f %8.2fx\n", c, scale_records / locked, scale_records / local, merge, base / local);
+    }
+    printf("Totals Match: %s\n", match ? "PASS" : "FAIL");
+
+    return 0;
+}
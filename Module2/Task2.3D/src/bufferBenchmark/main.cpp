@@ -0,0 +1,257 @@
+#include <iostream>
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include "../trafficSimulator/ts_buffer.h"
+
+#define DEFAULT_OPS 2000000
+#define CAPACITY 100
+#define DEFAULT_BATCH 64
+
+using namespace std;
+using namespace chrono;
+
+// Throughput and latency of the traffic simulator's buffer: the original
+// mutex ring (below, as it was) against ts_buffer on its spsc and mpmc rings.
+// Each item carries its push time, consumers record push-to-pop latency.
+// The bulk rows move batch items per push_bulk/pop_bulk.
+//
+// usage: bufferBenchmark [ops] [capacity] [batch]
+
+// the original ts_buffer
+template <class T>
+class locked_buffer {
+public:
+	explicit locked_buffer(int capacity):
+		_buf(new T[capacity + 1]),
+		_capacity(capacity + 1),
+		_tail(0),
+		_head(0)
+	{
+		pthread_mutex_init(&_pushLock, NULL);
+		pthread_mutex_init(&_popLock, NULL);
+	}
+	~locked_buffer()
+    {
+		delete [] _buf;
+	}
+
+	bool push(T item) {
+
+        pthread_mutex_lock(&_pushLock);
+
+        // wait for available capacity
+        while (1) {
+            int t = _tail;
+            if (_isFull(_head, t)) {
+                sleep(0.1);
+            }
+            else {
+                break;
+            }
+        }
+
+        _buf[_head] = item;
+
+        if (_head == _capacity - 1) _head = 0;
+        else _head++;
+
+        pthread_mutex_unlock(&_pushLock);
+        return true;
+    };
+
+	bool pop(T* item) {
+
+        pthread_mutex_lock(&_popLock);
+
+        int h = _head;
+        if ( _isEmpty(h, _tail) )
+        {
+            pthread_mutex_unlock(&_popLock);
+            return false;
+        }
+
+        *item = _buf[_tail];
+
+        if (_tail == _capacity - 1) _tail = 0;
+        else _tail++;
+
+        pthread_mutex_unlock(&_popLock);
+        return true;
+    };
+
+private:
+	T* _buf;
+	int _capacity;
+	int _tail;
+	int _head;
+	pthread_mutex_t _pushLock;
+	pthread_mutex_t _popLock;
+
+    bool _isEmpty(int h, int t) {
+
+	    return (h - t) == 0;
+    };
+
+    bool _isFull(int h, int t) {
+
+        if (h > t) t += _capacity;
+        return (t - h) == 1;
+    };
+
+};
+
+// same size as the simulator's buf_t
+struct item_t {
+    long sent;      // steady clock ns at push
+    int producer, seq;
+};
+
+struct result_t {
+    double ops_per_sec;
+    long p50, p99, p999, max;   // ns
+};
+
+static inline long now_ns() {
+    return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+// the original pop never blocks, consumers poll until every item is taken
+size_t bench_pop(locked_buffer<item_t> &q, item_t* items, size_t, atomic<long> &taken, long ops) {
+
+    while (taken.load(memory_order_relaxed) < ops) {
+        if (q.pop(items)) {
+            taken.fetch_add(1, memory_order_relaxed);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+size_t bench_pop(ts_buffer<item_t> &q, item_t* items, size_t max, atomic<long> &, long) {
+    return q.pop_bulk(items, max);
+}
+
+void bench_push(locked_buffer<item_t> &q, const vector<item_t> &items) {
+    for (const item_t &item : items) q.push(item);
+}
+
+void bench_push(ts_buffer<item_t> &q, const vector<item_t> &items) {
+    q.push_bulk(items);
+}
+
+void bench_close(locked_buffer<item_t> &) {}
+
+void bench_close(ts_buffer<item_t> &q) {
+    q.close();
+}
+
+template <class Q>
+result_t run(Q &q, int producers, int consumers, long ops, int batch) {
+
+    atomic<long> taken(0);
+    vector<vector<long>> latencies(consumers);
+    vector<thread> threads;
+
+    high_resolution_clock::time_point start = high_resolution_clock::now();
+
+    for (int c = 0; c < consumers; c++) {
+        threads.emplace_back([&, c]() {
+            latencies[c].reserve(ops / consumers + 1);
+            vector<item_t> items(batch);
+            size_t n;
+            while ((n = bench_pop(q, items.data(), batch, taken, ops)) > 0) {
+                long now = now_ns();
+                for (size_t i = 0; i < n; i++) latencies[c].push_back(now - items[i].sent);
+            }
+        });
+    }
+
+    vector<thread> pushers;
+    for (int p = 0; p < producers; p++) {
+        pushers.emplace_back([&, p]() {
+            long count = ops * (p + 1) / producers - ops * p / producers;
+            vector<item_t> items;
+            for (long i = 0; i < count; i++) {
+                item_t item = {now_ns(), p, (int)i};
+                items.push_back(item);
+                if ((int)items.size() == batch || i == count - 1) {
+                    bench_push(q, items);
+                    items.clear();
+                }
+            }
+        });
+    }
+
+    for (thread &t : pushers) t.join();
+    bench_close(q);
+    for (thread &t : threads) t.join();
+
+    duration<double> elapsed = duration_cast<duration<double>>(high_resolution_clock::now() - start);
+
+    vector<long> all;
+    for (vector<long> &l : latencies) all.insert(all.end(), l.begin(), l.end());
+    sort(all.begin(), all.end());
+
+    result_t r = {ops / elapsed.count(), 0, 0, 0, 0};
+    if (!all.empty()) {
+        r.p50 = all[all.size() / 2];
+        r.p99 = all[all.size() * 99 / 100];
+        r.p999 = all[all.size() * 999 / 1000];
+        r.max = all.back();
+    }
+    if ((long)all.size() != ops) printf("lost items: %ld of %ld\n", ops - (long)all.size(), ops);
+    return r;
+}
+
+void report(const char* name, int producers, int consumers, const result_t &r) {
+    printf("%-10s %2d %2d %14.0f %10ld %10ld %10ld %12ld\n", name, producers, consumers, r.ops_per_sec, r.p50, r.p99, r.p999, r.max);
+}
+
+int main(int argc, char** argv) {
+
+    long ops = DEFAULT_OPS;
+    int capacity = CAPACITY;
+    int batch = DEFAULT_BATCH;
+    if (argc > 1) ops = atol(argv[1]);
+    if (argc > 2) capacity = atoi(argv[2]);
+    if (argc > 3) batch = atoi(argv[3]);
+    if (batch < 1) batch = 1;
+
+    printf("%ld items, capacity %d, batch %d, %u hardware threads\n\n", ops, capacity, batch, thread::hardware_concurrency());
+    printf("%-10s %2s %2s %14s %10s %10s %10s %12s\n", "queue", "P", "C", "ops/s", "p50 ns", "p99 ns", "p99.9 ns", "max ns");
+
+    int configs[][2] = {{1, 1}, {2, 2}, {4, 4}};
+    for (auto &config : configs) {
+        int producers = config[0], consumers = config[1];
+
+        {
+            locked_buffer<item_t> q(capacity);
+            report("locked", producers, consumers, run(q, producers, consumers, ops, 1));
+        }
+        if (producers == 1 && consumers == 1) {
+            ts_buffer<item_t> q(capacity, true);
+            report("spsc", producers, consumers, run(q, producers, consumers, ops, 1));
+        }
+        if (producers == 1 && consumers == 1) {
+            ts_buffer<item_t> q(capacity, true);
+            report("spsc-bulk", producers, consumers, run(q, producers, consumers, ops, batch));
+        }
+        {
+            ts_buffer<item_t> q(capacity);
+            report("mpmc", producers, consumers, run(q, producers, consumers, ops, 1));
+        }
+        {
+            ts_buffer<item_t> q(capacity);
+            report("mpmc-bulk", producers, consumers, run(q, producers, consumers, ops, batch));
+        }
+    }
+
+    return 0;
+}
@@ -11,7 +11,7 @@ using namespace std;
 int main(int argc, char* argv[]) {
     
     int trafficLights = DEFAULT_LIGHTS;
-    if (argc > 1) trafficLights = atoi(argv[0]);
+    if (argc > 1) trafficLights = atoi(argv[1]);
     
     long ts = time(NULL);
     
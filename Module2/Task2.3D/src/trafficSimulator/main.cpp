@@ -1,239 +1,143 @@
 #include <iostream>
-#include <fstream>
-#include <sstream>
-#include <string>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <pthread.h>
+#include <atomic>
+#include <chrono>
 #include <vector>
 #include <algorithm>
 #include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "ts_buffer.h"
+#include "traffic_index.h"
 
 #define CAPACITY 100
 
-using namespace std;
-
-template <class T>
-class ts_buffer {
-public:
-	explicit ts_buffer(int capacity):
-		_buf(new T[capacity + 1]),
-		_capacity(capacity + 1),
-		_tail(0),
-		_head(0)
-	{
-		pthread_mutex_init(&_pushLock, NULL);
-		pthread_mutex_init(&_popLock, NULL);
-	}
-	~ts_buffer()
-    {
-		delete [] _buf;
-	}
-
-	bool push(T item) {
-
-        pthread_mutex_lock(&_pushLock);
-
-        // wait for available capacity
-        while (1) {
-            int t = _tail;
-            if (_isFull(_head, t)) {
-                sleep(0.1);
-            }
-            else {
-                break;
-            }
-        }
-        
-        _buf[_head] = item;
-        
-        if (_head == _capacity - 1) _head = 0;
-        else _head++;
-        
-        pthread_mutex_unlock(&_pushLock);
-        return true;
-    };
-
-	bool pop(T* item) {
-	
-        pthread_mutex_lock(&_popLock);
-
-        int h = _head;
-        if ( _isEmpty(h, _tail) )
-        {
-            pthread_mutex_unlock(&_popLock);	
-            return false;
-        }
-
-        *item = _buf[_tail];
-        
-        if (_tail == _capacity - 1) _tail = 0;
-        else _tail++;
-        
-        pthread_mutex_unlock(&_popLock);
-        return true;
-    };
-
-private:
-	T* _buf;
-	int _capacity;
-	int _tail;
-	int _head;
-	pthread_mutex_t _pushLock;
-	pthread_mutex_t _popLock;
-
-    bool _isEmpty(int h, int t) {
-	
-	    return (h - t) == 0;
-    };
-
-    bool _isFull(int h, int t) {
-	
-        if (h > t) t += _capacity;
-        return (t - h) == 1;
-    };
+// records per buffer push/pop
+#define DEFAULT_BATCH 256
 
-};
+using namespace std;
 
 struct buf_t {
     int id, cars;
     long ts;
 };
 
-struct light_t {
-    int id, total;
-
-    bool operator<(const light_t& a) {
-        return !(total < a.total);
-    }
-};
-
-struct hour_t {
-    struct tm timeinfo;
-    vector<light_t> lights;
-    vector<light_t> topN;
+// a producer's share of the mapped input, whole lines only
+struct range_t {
+    const char* begin;
+    const char* end;
 };
 
-bool operator==(const tm& a, const tm& b) {
-    return (
-        a.tm_year == b.tm_year &&
-        a.tm_mon == b.tm_mon &&
-        a.tm_mday == b.tm_mday &&
-        a.tm_hour == b.tm_hour
-    );
-}
-
-ts_buffer<buf_t> buf(CAPACITY);
-vector<hour_t> hours;
-fstream fin;
-pthread_mutex_t fin_lock;
+ts_buffer<buf_t>* buf;
+traffic_index hours;     // merged totals
 pthread_mutex_t hours_lock;
 int top;
+int batch;
+int interim;            // ms between interim merges into hours, 0 for none
+atomic<bool> consuming;
 
-void* producer(void* argv) {
+// parse a decimal integer at p and move p past it
+static inline long parse_long(const char* &p, const char* end) {
 
-    while (1) {
+    bool negative = p < end && *p == '-';
+    if (negative) p++;
 
-        pthread_mutex_lock(&fin_lock);
-        
-        // try to read a line, terminate if no more lines
-        string row;
-        if (!getline(fin, row)) {
-            pthread_mutex_unlock(&fin_lock);
-            break;
-        }
-        
-        pthread_mutex_unlock(&fin_lock);
+    long value = 0;
+    while (p < end && (unsigned)(*p - '0') < 10) value = value * 10 + (*p++ - '0');
+    return negative ? -value : value;
+}
 
-        // read csv data to buf_t struct
-        struct buf_t data;
-        string col;
-        stringstream ss(row);
+// parse one "id,ts,cars" line at p and move p to the next line, false if malformed
+static inline bool parse_row(const char* &p, const char* end, buf_t* data) {
+
+    bool ok = true;
+    data->id = parse_long(p, end);
+    if (p < end && *p == ',') p++;
+    else ok = false;
+    data->ts = parse_long(p, end);
+    if (p < end && *p == ',') p++;
+    else ok = false;
+    data->cars = parse_long(p, end);
+
+    // skip a \r and anything else left on the line
+    while (p < end && *p != '\n') p++;
+    if (p < end) p++;
+    return ok;
+}
+
+void* producer(void* argv) {
 
-        getline(ss, col, ',');
-        data.id = stoi(col);
+    range_t* range = (range_t*)argv;
+    vector<buf_t> records(batch);
+
+    // parse the range in place, queue a batch at a time
+    const char* p = range->begin;
+    int n = 0;
+    while (p < range->end) {
+        if (parse_row(p, range->end, &records[n])) n++;
+        if (n == batch) {
+            buf->push_bulk(span<const buf_t>(records.data(), n));
+            n = 0;
+        }
+    }
+    if (n > 0) buf->push_bulk(span<const buf_t>(records.data(), n));
 
-        getline(ss, col, ',');
-        data.ts = stol(col);
+    return NULL;
+}
 
-        getline(ss, col);
-        data.cars = stoi(col);
+// start of the line that holds offset pos
+static const char* line_start(const char* data, size_t size, size_t pos) {
 
-        // queue data in buffer
-        buf.push(data);
-    }
+    if (pos == 0 || pos >= size) return data + min(pos, size);
+    const char* p = (const char*)memchr(data + pos - 1, '\n', size - pos + 1);
+    return p == NULL ? data + size : p + 1;
 }
 
+// every consumer aggregates into its own table, no lock per record. with
+// interim merges on, it moves its table into hours every interim ms.
 void* consumer(void* argv) {
 
-    while (1) {
-        // try to get data from buffer
-        struct buf_t data;
-        bool dataIn = false;
+    traffic_index* local = (traffic_index*)argv;
+    vector<buf_t> records(batch);
+    chrono::steady_clock::time_point next = chrono::steady_clock::now() + chrono::milliseconds(interim);
 
-        dataIn = buf.pop(&data);
+    // take batches from the buffer until it is closed and drained
+    size_t n;
+    while ((n = buf->pop_bulk(records.data(), batch)) > 0) {
 
-        if (dataIn) {
-            
-            // get date and hour from timestamp, clear minutes and seconds
-            time_t rawtime = static_cast<time_t>(data.ts);
-            struct tm timeinfo = *localtime(&rawtime);
-            timeinfo.tm_min = 0;
-            timeinfo.tm_sec = 0;
+        // add each sample to its hour and light
+        for (size_t i = 0; i < n; i++) local->add(records[i].id, records[i].ts, records[i].cars);
 
-            // begin critical section
+        if (interim > 0 && chrono::steady_clock::now() >= next) {
             pthread_mutex_lock(&hours_lock);
-            
-            // find hour collection
-            int hr = -1;
-            for (int i = 0; i < hours.size(); i++) {
-                if (hours[i].timeinfo == timeinfo) {
-                    hr = i;
-                    break;
-                }
-            }
-            // add new if hour not found
-            if (hr == -1) {
-                hour_t h;
-                h.timeinfo = timeinfo;
-                hours.push_back(h);
-                hr = hours.size() - 1;
-            }
-            
-            // find traffic light collection
-            int lt = -1;
-            for (int i = 0; i < hours[hr].lights.size(); i++) {
-                if (hours[hr].lights[i].id == data.id) {
-                    lt = i;
-                    break;
-                }
-            }
-            // add new if traffic light not found
-            if (lt == -1) {
-                light_t l;
-                l.id = data.id;
-                hours[hr].lights.push_back(l);
-                lt = hours[hr].lights.size() - 1;
-            }
-
-            // append sample data
-            hours[hr].lights[lt].total += data.cars;
-            
-            // copy new aggregate data to topN
-            hours[hr].topN = vector<light_t>(hours[hr].lights);
-
-            // sort and truncate topN
-            sort(hours[hr].topN.begin(), hours[hr].topN.end());
-            hours[hr].topN.resize(top);
-
-            // end critical section
+            hours.merge(*local);
             pthread_mutex_unlock(&hours_lock);
-            
-        }
-        else {
-            // if no data and input file is empty, terminate
-            if (fin.eof()) break;
+            local->clear();
+            next = chrono::steady_clock::now() + chrono::milliseconds(interim);
         }
     }
+
+    return NULL;
+}
+
+// print a line about the merged totals every interim ms while consumers run
+void* reporter(void*) {
+
+    while (consuming.load()) {
+        usleep(interim * 1000);
+
+        pthread_mutex_lock(&hours_lock);
+        long cars = 0;
+        for (int hr = 0; hr < hours.hours(); hr++) cars += hours.cars(hr);
+        fprintf(stderr, "Interim: %d hours, %ld cars merged.\n", hours.hours(), cars);
+        pthread_mutex_unlock(&hours_lock);
+    }
+
+    return NULL;
 }
 
 int main(int argc, char** argv) {
@@ -242,51 +146,107 @@ int main(int argc, char** argv) {
     int producers = 1;
     int consumers = 1;
     top = 5;
+    batch = DEFAULT_BATCH;
+    interim = 0;
 
     // read args
     if (argc > 1) producers = atoi(argv[1]);
     if (argc > 2) consumers = atoi(argv[2]);
     if (argc > 3) top = atoi(argv[3]);
+    if (argc > 4) batch = atoi(argv[4]);
+    if (argc > 5) interim = atoi(argv[5]);
+    if (batch < 1) batch = 1;
 
     // init pthread refs
     pthread_t p_threads[producers];
-    pthread_t c_threads[producers];
+    pthread_t c_threads[consumers];
+    pthread_t r_thread;
 
     // init mutex
-    pthread_mutex_init(&fin_lock, NULL);
     pthread_mutex_init(&hours_lock, NULL);
 
-    // open input file
-    fin.open("trafficData.csv");
+    // map input file
+    int fd = open("trafficData.csv", O_RDONLY);
+    if (fd == -1) {
+        perror("Failed to open trafficData.csv. Exiting...\n");
+        exit(1);
+    }
+    struct stat st;
+    if (fstat(fd, &st) == -1) {
+        perror("Failed to stat trafficData.csv. Exiting...\n");
+        exit(1);
+    }
+    size_t size = st.st_size;
+    const char* input = NULL;
+    if (size > 0) {
+        input = (const char*)mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (input == MAP_FAILED) {
+            perror("Failed to map trafficData.csv. Exiting...\n");
+            exit(1);
+        }
+        madvise((void*)input, size, MADV_SEQUENTIAL);
+    }
+    close(fd);
+
+    // one newline-aligned range per producer
+    range_t ranges[producers];
+    for (int i = 0; i < producers; i++) {
+        ranges[i].begin = line_start(input, size, size * i / producers);
+        ranges[i].end = line_start(input, size, size * (i + 1) / producers);
+    }
+
+    // lock-free buffer, the spsc ring when there is one thread on each side,
+    // with room for a couple of batches in flight
+    buf = new ts_buffer<buf_t>(max(CAPACITY, 2 * batch), producers == 1 && consumers == 1);
 
     // create producers
     for (int i = 0; i < producers; i++) {
-        pthread_create(&p_threads[i], NULL, producer, NULL);
+        pthread_create(&p_threads[i], NULL, producer, &ranges[i]);
     }
 
-    // create consumers
+    // create consumers, each with its own table
+    vector<traffic_index> partial(consumers);
+    consuming = true;
     for (int i = 0; i < consumers; i++) {
-        pthread_create(&c_threads[i], NULL, consumer, NULL);
+        pthread_create(&c_threads[i], NULL, consumer, &partial[i]);
     }
+    if (interim > 0) pthread_create(&r_thread, NULL, reporter, NULL);
 
-    // wait for producers to join
+    // wait for producers to join, then let consumers drain the buffer and stop
     for (int i = 0; i < producers; i++) {
         pthread_join(p_threads[i], NULL);
     }
+    buf->close();
 
     // wait for consumers to join
     for (int i = 0; i < consumers; i++) {
         pthread_join(c_threads[i], NULL);
     }
+    consuming = false;
+    if (interim > 0) pthread_join(r_thread, NULL);
 
-    // close input file
-    fin.close();
+    // merge what the consumers still hold
+    for (int i = 0; i < consumers; i++) {
+        hours.merge(partial[i]);
+    }
 
-    for (int i = 0; i < hours.size(); i++) {
-        printf("%s", asctime(&hours[i].timeinfo));
+    // unmap input file
+    if (size > 0) munmap((void*)input, size);
+    delete buf;
+
+    // top lights of every hour, in time order
+    vector<light_t> topN;
+    for (int hr : hours.hour_order()) {
+        // local hours are already offset, so no second conversion
+        time_t rawtime = static_cast<time_t>(hours.epoch_hour(hr) * 3600);
+        struct tm timeinfo;
+        gmtime_r(&rawtime, &timeinfo);
+        hours.top(hr, top, topN);
+
+        printf("%s", asctime(&timeinfo));
         printf("--------------------------\n");
-        for (int j = 0; j < hours[i].topN.size(); j++) {
-            printf("Traffic Light %02d - %d cars.\n", hours[i].topN[j].id, hours[i].topN[j].total);
+        for (int j = 0; j < (int)topN.size(); j++) {
+            printf("Traffic Light %02d - %d cars.\n", topN[j].id, topN[j].total);
         }
         printf("\n");
     }
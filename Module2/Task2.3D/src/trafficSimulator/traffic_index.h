@@ -0,0 +1,203 @@
+#ifndef TRAFFIC_INDEX_H
+#define TRAFFIC_INDEX_H
+
+#include <limits.h>
+#include <time.h>
+#include <algorithm>
+#include <unordered_map>
+#include <vector>
+
+// Car totals per (hour, traffic light), updated in O(1).
+//
+// Hours are local hours, as the simulator has always reported them: keyed by
+// floor((ts + utc offset) / 3600), so epoch_hour() * 3600 is the start of the
+// hour in local time (print it with gmtime_r, not localtime_r). The offset is
+// looked up with localtime_r once per quarter hour of ts, the granularity of
+// every zone's transitions. Keys go through a hash map into a vector of
+// buckets; records mostly arrive in time order, so the last hour looked up is
+// checked first. Light ids are mapped to dense indices, directly
+// through a vector for small non-negative ids and through a hash map for any
+// other id, and every hour keeps a flat array of totals by dense index.
+// A light that never reported in an hour holds TI_ABSENT there, so it is left
+// out of that hour's top list just as before.
+//
+// Top-N lists are not maintained on every update: top() selects them from
+// an hour's totals when asked.
+//
+// Tables built separately (one per consumer thread) are combined with
+// merge(), which adds every total of the other table into this one, one
+// hour bucket at a time.
+
+// ids in [0, TI_DIRECT_IDS) are mapped without hashing
+#define TI_DIRECT_IDS (1 << 20)
+
+#define TI_ABSENT INT_MIN
+
+struct light_t {
+    int id, total;
+
+    // more cars first, then lower id
+    bool operator<(const light_t& a) const {
+        if (total != a.total) return total > a.total;
+        return id < a.id;
+    }
+};
+
+static inline long ti_epoch_hour(long ts) {
+    return ts >= 0 ? ts / 3600 : (ts - 3599) / 3600;
+}
+
+class traffic_index {
+public:
+    traffic_index():
+        _last_hour(0),
+        _last_bucket(-1),
+        _offset(0),
+        _offset_quarter(LONG_MIN)
+    {}
+
+    // add cars seen by light id at timestamp ts
+    void add(int id, long ts, int cars) {
+
+        int light = _light(id);
+        std::vector<int> &totals = _buckets[_hour(_local_hour(ts))].totals;
+        if (light >= (int)totals.size()) totals.resize(_ids.size(), TI_ABSENT);
+
+        int &total = totals[light];
+        if (total == TI_ABSENT) total = 0;
+        total += cars;
+    }
+
+    // add every total of other into this table
+    void merge(const traffic_index &other) {
+
+        // other's dense light indices in this table
+        std::vector<int> light(other._ids.size());
+        for (int i = 0; i < (int)light.size(); i++) light[i] = _light(other._ids[i]);
+
+        for (const bucket_t &from : other._buckets) {
+            std::vector<int> &totals = _buckets[_hour(from.hour)].totals;
+            if (totals.size() < _ids.size()) totals.resize(_ids.size(), TI_ABSENT);
+
+            for (int i = 0; i < (int)from.totals.size(); i++) {
+                if (from.totals[i] == TI_ABSENT) continue;
+                int &total = totals[light[i]];
+                if (total == TI_ABSENT) total = 0;
+                total += from.totals[i];
+            }
+        }
+    }
+
+    // forget every total, keep the light directory
+    void clear() {
+
+        _buckets.clear();
+        _hour_bucket.clear();
+        _last_bucket = -1;
+    }
+
+    int hours() const { return _buckets.size(); }
+    int lights() const { return _ids.size(); }
+    long epoch_hour(int bucket) const { return _buckets[bucket].hour; }
+
+    // cars counted in a bucket
+    long cars(int bucket) const {
+
+        long sum = 0;
+        for (int total : _buckets[bucket].totals)
+            if (total != TI_ABSENT) sum += total;
+        return sum;
+    }
+
+    // buckets in time order
+    std::vector<int> hour_order() const {
+
+        std::vector<int> order(_buckets.size());
+        for (int i = 0; i < (int)order.size(); i++) order[i] = i;
+        std::sort(order.begin(), order.end(), [this](int a, int b) {
+            return _buckets[a].hour < _buckets[b].hour;
+        });
+        return order;
+    }
+
+    // the n busiest lights of a bucket, padded with {0, 0} when fewer reported
+    void top(int bucket, int n, std::vector<light_t> &out) const {
+
+        const std::vector<int> &totals = _buckets[bucket].totals;
+        out.clear();
+        for (int i = 0; i < (int)totals.size(); i++)
+            if (totals[i] != TI_ABSENT) out.push_back({_ids[i], totals[i]});
+
+        int keep = std::min(n, (int)out.size());
+        std::partial_sort(out.begin(), out.begin() + keep, out.end());
+        out.resize(n, light_t{0, 0});
+    }
+
+private:
+    struct bucket_t {
+        long hour;
+        std::vector<int> totals;    // by dense light index
+    };
+
+    std::vector<bucket_t> _buckets;
+    std::unordered_map<long, int> _hour_bucket;
+    long _last_hour;
+    int _last_bucket;
+
+    long _offset;                       // utc offset of the quarter hour below
+    long _offset_quarter;
+
+    std::vector<int> _ids;              // dense index -> id
+    std::vector<int> _direct;           // small id -> dense index, -1 if unseen
+    std::unordered_map<int, int> _other;
+
+    int _hour(long hour) {
+
+        if (_last_bucket >= 0 && hour == _last_hour) return _last_bucket;
+
+        std::unordered_map<long, int>::iterator it = _hour_bucket.find(hour);
+        int bucket;
+        if (it != _hour_bucket.end()) bucket = it->second;
+        else {
+            bucket = _buckets.size();
+            _buckets.push_back({hour, std::vector<int>(_ids.size(), TI_ABSENT)});
+            _hour_bucket[hour] = bucket;
+        }
+
+        _last_hour = hour;
+        _last_bucket = bucket;
+        return bucket;
+    }
+
+    long _local_hour(long ts) {
+
+        long quarter = ts >= 0 ? ts / 900 : (ts - 899) / 900;
+        if (quarter != _offset_quarter) {
+            time_t rawtime = static_cast<time_t>(ts);
+            struct tm timeinfo;
+            localtime_r(&rawtime, &timeinfo);
+            _offset = timeinfo.tm_gmtoff;
+            _offset_quarter = quarter;
+        }
+        return ti_epoch_hour(ts + _offset);
+    }
+
+    int _light(int id) {
+
+        if (id >= 0 && id < TI_DIRECT_IDS) {
+            if (id < (int)_direct.size() && _direct[id] >= 0) return _direct[id];
+            if (id >= (int)_direct.size()) _direct.resize(std::min(std::max(id + 1, 2 * (int)_direct.size()), TI_DIRECT_IDS), -1);
+            _direct[id] = _ids.size();
+        }
+        else {
+            std::unordered_map<int, int>::iterator it = _other.find(id);
+            if (it != _other.end()) return it->second;
+            _other[id] = _ids.size();
+        }
+
+        _ids.push_back(id);
+        return _ids.size() - 1;
+    }
+};
+
+#endif
@@ -0,0 +1,352 @@
+#ifndef TS_BUFFER_H
+#define TS_BUFFER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <algorithm>
+#include <atomic>
+#include <span>
+
+// Bounded lock-free queues for the producer/consumer pipeline (C++20, for
+// std::atomic::wait).
+//
+// spsc_ring is the single-producer single-consumer fast path: head and tail
+// each live on their own cache line, and each side keeps a private copy of
+// the other side's index so it only touches the shared line when the ring
+// looks full (or empty).
+//
+// mpmc_ring is Dmitry Vyukov's bounded MPMC queue: every cell carries a
+// sequence number that says whether it is ready to be written for lap n or
+// read for lap n, so producers and consumers claim cells with one CAS on
+// their own index and never lock.
+//
+// Both rings also move items in bulk: a batch is claimed with one index
+// update (one release store, or one CAS), so the synchronisation cost is paid
+// per batch rather than per item.
+//
+// ts_buffer wraps either ring with blocking push/pop and their bulk forms.
+// A thread that finds the ring full (empty) spins briefly, then registers as
+// a waiter and sleeps with std::atomic::wait (a futex on linux) on an event
+// counter that the other side only bumps when somebody is waiting, so the
+// fast path makes no system calls. close() wakes every consumer; pop then
+// drains what is left and returns false once the queue is empty.
+
+#define TS_CACHE_LINE 64
+
+// spins before a blocked push or pop goes to sleep
+#define TS_SPINS 128
+
+static inline void ts_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#endif
+}
+
+static inline size_t ts_ring_size(size_t capacity) {
+
+    size_t size = 2;
+    while (size < capacity) size <<= 1;
+    return size;
+}
+
+template <class T>
+class spsc_ring {
+public:
+    explicit spsc_ring(size_t capacity):
+        _buf(new T[ts_ring_size(capacity)]),
+        _mask(ts_ring_size(capacity) - 1),
+        _head(0),
+        _tail_cache(0),
+        _tail(0),
+        _head_cache(0)
+    {}
+    ~spsc_ring()
+    {
+        delete [] _buf;
+    }
+
+    // push up to n items, returns how many fit
+    size_t try_push_bulk(const T* items, size_t n) {
+
+        size_t h = _head.load(std::memory_order_relaxed);
+        size_t space = _mask + 1 - (h - _tail_cache);
+        if (space < n) {
+            _tail_cache = _tail.load(std::memory_order_acquire);
+            space = _mask + 1 - (h - _tail_cache);
+        }
+
+        size_t count = std::min(n, space);
+        for (size_t i = 0; i < count; i++) _buf[(h + i) & _mask] = items[i];
+        if (count > 0) _head.store(h + count, std::memory_order_release);
+        return count;
+    }
+
+    // pop up to max items, returns how many there were
+    size_t try_pop_bulk(T* items, size_t max) {
+
+        size_t t = _tail.load(std::memory_order_relaxed);
+        size_t available = _head_cache - t;
+        if (available < max) {
+            _head_cache = _head.load(std::memory_order_acquire);
+            available = _head_cache - t;
+        }
+
+        size_t count = std::min(max, available);
+        for (size_t i = 0; i < count; i++) items[i] = _buf[(t + i) & _mask];
+        if (count > 0) _tail.store(t + count, std::memory_order_release);
+        return count;
+    }
+
+    bool try_push(const T &item) { return try_push_bulk(&item, 1) == 1; }
+    bool try_pop(T* item) { return try_pop_bulk(item, 1) == 1; }
+
+    size_t capacity() const { return _mask + 1; }
+
+private:
+    T* _buf;
+    size_t _mask;
+
+    // producer side
+    alignas(TS_CACHE_LINE) std::atomic<size_t> _head;
+    size_t _tail_cache;
+
+    // consumer side
+    alignas(TS_CACHE_LINE) std::atomic<size_t> _tail;
+    size_t _head_cache;
+};
+
+template <class T>
+class mpmc_ring {
+public:
+    explicit mpmc_ring(size_t capacity):
+        _cells(new cell[ts_ring_size(capacity)]),
+        _mask(ts_ring_size(capacity) - 1),
+        _enqueue(0),
+        _dequeue(0)
+    {
+        for (size_t i = 0; i <= _mask; i++)
+            _cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+    ~mpmc_ring()
+    {
+        delete [] _cells;
+    }
+
+    // push up to n items, returns how many fit. the run of free cells from
+    // the enqueue index is claimed with one CAS, cells can only leave the free
+    // state for their lap through the producer that claims them.
+    size_t try_push_bulk(const T* items, size_t n) {
+
+        size_t count;
+        size_t pos = _enqueue.load(std::memory_order_relaxed);
+        while (1) {
+            size_t seq = _cells[pos & _mask].sequence.load(std::memory_order_acquire);
+            intptr_t dif = (intptr_t)seq - (intptr_t)pos;
+
+            // still holds last lap's item: full
+            if (dif < 0) return 0;
+
+            // another producer took it
+            if (dif > 0) {
+                pos = _enqueue.load(std::memory_order_relaxed);
+                continue;
+            }
+
+            // free for this lap, extend over the free cells after it and claim them
+            count = 1;
+            while (count < n && _cells[(pos + count) & _mask].sequence.load(std::memory_order_acquire) == pos + count)
+                count++;
+            if (_enqueue.compare_exchange_weak(pos, pos + count, std::memory_order_relaxed)) break;
+        }
+
+        for (size_t i = 0; i < count; i++) {
+            cell* c = &_cells[(pos + i) & _mask];
+            c->data = items[i];
+            c->sequence.store(pos + i + 1, std::memory_order_release);
+        }
+        return count;
+    }
+
+    // pop up to max items, returns how many there were
+    size_t try_pop_bulk(T* items, size_t max) {
+
+        size_t count;
+        size_t pos = _dequeue.load(std::memory_order_relaxed);
+        while (1) {
+            size_t seq = _cells[pos & _mask].sequence.load(std::memory_order_acquire);
+            intptr_t dif = (intptr_t)seq - (intptr_t)(pos + 1);
+
+            // not written yet: empty
+            if (dif < 0) return 0;
+
+            if (dif > 0) {
+                pos = _dequeue.load(std::memory_order_relaxed);
+                continue;
+            }
+
+            count = 1;
+            while (count < max && _cells[(pos + count) & _mask].sequence.load(std::memory_order_acquire) == pos + count + 1)
+                count++;
+            if (_dequeue.compare_exchange_weak(pos, pos + count, std::memory_order_relaxed)) break;
+        }
+
+        for (size_t i = 0; i < count; i++) {
+            cell* c = &_cells[(pos + i) & _mask];
+            items[i] = c->data;
+            c->sequence.store(pos + i + _mask + 1, std::memory_order_release);
+        }
+        return count;
+    }
+
+    bool try_push(const T &item) { return try_push_bulk(&item, 1) == 1; }
+    bool try_pop(T* item) { return try_pop_bulk(item, 1) == 1; }
+
+    size_t capacity() const { return _mask + 1; }
+
+private:
+    struct cell {
+        std::atomic<size_t> sequence;
+        T data;
+    };
+
+    cell* _cells;
+    size_t _mask;
+    alignas(TS_CACHE_LINE) std::atomic<size_t> _enqueue;
+    alignas(TS_CACHE_LINE) std::atomic<size_t> _dequeue;
+};
+
+template <class T>
+class ts_buffer {
+public:
+    // single: exactly one thread pushes and one thread pops, use the spsc ring
+    explicit ts_buffer(int capacity, bool single = false):
+        _spsc(single ? new spsc_ring<T>(capacity) : NULL),
+        _mpmc(single ? NULL : new mpmc_ring<T>(capacity)),
+        _push_waiters(0),
+        _pushed(0),
+        _pop_waiters(0),
+        _popped(0),
+        _closed(false)
+    {}
+    ~ts_buffer()
+    {
+        delete _spsc;
+        delete _mpmc;
+    }
+
+    size_t try_push_bulk(const T* items, size_t n) {
+        return _spsc != NULL ? _spsc->try_push_bulk(items, n) : _mpmc->try_push_bulk(items, n);
+    }
+
+    size_t try_pop_bulk(T* items, size_t max) {
+        return _spsc != NULL ? _spsc->try_pop_bulk(items, max) : _mpmc->try_pop_bulk(items, max);
+    }
+
+    // push every item, waiting for space as needed, false if the buffer was closed
+    bool push_bulk(std::span<const T> items) {
+
+        const T* next = items.data();
+        size_t left = items.size();
+
+        for (int spin = 0; left > 0; ) {
+            size_t count = try_push_bulk(next, left);
+            if (count == 0) {
+                if (_closed.load(std::memory_order_acquire)) return false;
+                if (spin++ < TS_SPINS) {
+                    ts_relax();
+                    continue;
+                }
+
+                uint32_t event = _popped.load(std::memory_order_acquire);
+                _push_waiters.fetch_add(1, std::memory_order_seq_cst);
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                count = try_push_bulk(next, left);
+                if (count == 0 && !_closed.load(std::memory_order_acquire))
+                    _popped.wait(event, std::memory_order_acquire);
+                _push_waiters.fetch_sub(1, std::memory_order_relaxed);
+                if (count == 0) continue;
+            }
+
+            next += count;
+            left -= count;
+            spin = 0;
+            _signal(_pop_waiters, _pushed);
+        }
+        return true;
+    }
+
+    // wait for items and take up to max of them, 0 once the buffer is closed and empty
+    size_t pop_bulk(T* items, size_t max) {
+
+        if (max == 0) return 0;
+
+        for (int spin = 0; ; ) {
+            size_t count = try_pop_bulk(items, max);
+            if (count == 0) {
+                if (spin++ < TS_SPINS) {
+                    ts_relax();
+                    continue;
+                }
+
+                uint32_t event = _pushed.load(std::memory_order_acquire);
+                _pop_waiters.fetch_add(1, std::memory_order_seq_cst);
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                count = try_pop_bulk(items, max);
+                bool closed = _closed.load(std::memory_order_acquire);
+                if (count == 0 && !closed)
+                    _pushed.wait(event, std::memory_order_acquire);
+                _pop_waiters.fetch_sub(1, std::memory_order_relaxed);
+                if (count == 0) {
+                    if (closed) return try_pop_bulk(items, max);
+                    continue;
+                }
+            }
+
+            _signal(_push_waiters, _popped);
+            return count;
+        }
+    }
+
+    // wait for space, false if the buffer was closed
+    bool push(T item) {
+        return push_bulk(std::span<const T>(&item, 1));
+    }
+
+    // wait for an item, false once the buffer is closed and empty
+    bool pop(T* item) {
+        return pop_bulk(item, 1) == 1;
+    }
+
+    // no more pushes: wake everyone, consumers drain the rest and stop
+    void close() {
+
+        _closed.store(true, std::memory_order_seq_cst);
+        _pushed.fetch_add(1, std::memory_order_release);
+        _pushed.notify_all();
+        _popped.fetch_add(1, std::memory_order_release);
+        _popped.notify_all();
+    }
+
+private:
+    spsc_ring<T>* _spsc;
+    mpmc_ring<T>* _mpmc;
+
+    // waiters register before their last try, and the other side checks for
+    // them after its own push or pop, the fences make sure one sees the other
+    alignas(TS_CACHE_LINE) std::atomic<int> _push_waiters;
+    std::atomic<uint32_t> _pushed;          // bumped after a push that has pop waiters
+    alignas(TS_CACHE_LINE) std::atomic<int> _pop_waiters;
+    std::atomic<uint32_t> _popped;          // bumped after a pop that has push waiters
+    alignas(TS_CACHE_LINE) std::atomic<bool> _closed;
+
+    static void _signal(std::atomic<int> &waiters, std::atomic<uint32_t> &event) {
+
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (waiters.load(std::memory_order_relaxed) > 0) {
+            event.fetch_add(1, std::memory_order_release);
+            event.notify_all();
+        }
+    }
+};
+
+#endif
@@ -1,13 +1,80 @@
+// element type, set by the host with -DELEM_T=<type> to match its matrices
+#ifndef ELEM_T
+#define ELEM_T int
+#endif
+
+// tile edge and outputs per work-item of multiply_matrices_tiled, chosen by
+// the host with -DTILE=<n> -DWPT=<n>. TILE must be a multiple of WPT.
+#ifndef TILE
+#define TILE 16
+#endif
+#ifndef WPT
+#define WPT 4
+#endif
+
+// work-items per tile row, each covers every RTS-th column of the tile
+#define RTS (TILE / WPT)
+
 __kernel void multiply_matrices(const int my_row_count, const int col_count,
-                                const __global int* a, const __global int* b, __global int* c) {
+                                const __global ELEM_T* a, const __global ELEM_T* b, __global ELEM_T* c) {
     
     const int row = get_global_id(0);
     const int col = get_global_id(1);
     const int el = row * col_count + col;
  
-    int total = 0;
+    ELEM_T total = 0;
     for (int i = 0; i < col_count; i++) {
         total += a[row * col_count + i] * b[i * col_count + col];
     }
     c[el] = total;
-}
\ No newline at end of file
+}
+
+// c = a * b for a my_row_count x col_count a and a square b. each work-group
+// computes a TILE x TILE block of c from TILE x TILE tiles of a and b staged in
+// local memory, and each work-item accumulates WPT outputs of one row in
+// registers. launch with local size {TILE, RTS} and global size
+// {my_row_count, col_count / WPT} rounded up to the local size, edges are
+// padded with zeros.
+__kernel __attribute__((reqd_work_group_size(TILE, RTS, 1)))
+void multiply_matrices_tiled(const int my_row_count, const int col_count,
+                             const __global ELEM_T* a, const __global ELEM_T* b, __global ELEM_T* c) {
+
+    const int local_row = get_local_id(0);
+    const int local_col = get_local_id(1);
+    const int row = get_group_id(0) * TILE + local_row;
+    const int col0 = get_group_id(1) * TILE;
+
+    __local ELEM_T a_tile[TILE][TILE];
+    __local ELEM_T b_tile[TILE][TILE];
+
+    ELEM_T acc[WPT];
+    for (int w = 0; w < WPT; w++) acc[w] = 0;
+
+    const int tiles = (col_count + TILE - 1) / TILE;
+    for (int t = 0; t < tiles; t++) {
+
+        // each work-item loads WPT elements of each tile
+        for (int w = 0; w < WPT; w++) {
+            const int tc = local_col + w * RTS;
+            const int a_col = t * TILE + tc;
+            const int b_row = t * TILE + local_row;
+            a_tile[local_row][tc] = (row < my_row_count && a_col < col_count) ? a[row * col_count + a_col] : 0;
+            b_tile[local_row][tc] = (b_row < col_count && col0 + tc < col_count) ? b[b_row * col_count + col0 + tc] : 0;
+        }
+        barrier(CLK_LOCAL_MEM_FENCE);
+
+        for (int k = 0; k < TILE; k++) {
+            const ELEM_T a_k = a_tile[local_row][k];
+            for (int w = 0; w < WPT; w++)
+                acc[w] += a_k * b_tile[k][local_col + w * RTS];
+        }
+        barrier(CLK_LOCAL_MEM_FENCE);
+    }
+
+    if (row < my_row_count) {
+        for (int w = 0; w < WPT; w++) {
+            const int col = col0 + local_col + w * RTS;
+            if (col < col_count) c[row * col_count + col] = acc[w];
+        }
+    }
+}
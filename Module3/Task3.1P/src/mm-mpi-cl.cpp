@@ -2,9 +2,14 @@
 #include <fstream>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <chrono>
 #include <mpi.h>
-#include <CL/cl.h>
+#include "../../../common/cl_runtime.h"
+#include "../../../common/matrix.h"
+#include "../../../common/matrix_mpi.h"
+#include "../../../common/matrix_io.h"
+#include "../../../common/matrix_rand.h"
 
 using namespace std;
 using namespace chrono;
@@ -12,24 +17,53 @@ using namespace chrono;
 // max value for a matrix element
 #define MAX_ELEMENT 20
 
+// autotuner problem size, timed runs per candidate and result cache
+#define TUNE_SIZE 512
+#define TUNE_RUNS 3
+#define TUNE_FILE "matrix_mul.tune"
+
+// tile edge and outputs per work-item of the tiled kernel, its work-group is tile x tile / wpt
+struct cl_tile_params {
+    int tile;
+    int wpt;
+};
+
+// device time of each stage of a cl_matrix_mul call, from profiling events
+struct cl_mul_times {
+    double upload;      // a and b writes (0 with zero copy)
+    double kernel;
+    double download;    // c read, or c map with zero copy
+};
+
 // forward declarations
-int** new_matrix(int, int);
-int** new_rand_matrix(int, int);
-int** new_zero_matrix(int, int);
-void free_matrix(int**);
-void cl_matrix_mul(int**, int**, int**, size_t, size_t);
-cl_device_id create_cl_device();
-cl_program create_cl_program(cl_context, cl_device_id, const char*);
+Matrix<elem_t> new_rand_matrix(int, int, uint64_t, uint32_t, int);
+Matrix<elem_t> new_zero_matrix(int, int);
+void cl_matrix_mul(const Matrix<elem_t>&, const Matrix<elem_t>&, Matrix<elem_t>&, size_t, size_t, const cl_tile_params&, bool, cl_mul_times*);
+cl_tile_params cl_autotune(bool);
+string cl_kernel_options(const cl_tile_params&);
 
 int main(int argc, char **argv) {
     
     MPI_Init(&argc, &argv);
     
-    //srand(time(NULL));
-
-    // get matrix size (rows, cols)
+    // get matrix size (rows, cols), --no-inputs writes only the product, --tile N and --wpt N
+    // fix the kernel's tiling instead of using the tuned one, --retune ignores the tuning cache,
+    // --zero-copy lets the device use the matrices' host memory instead of copying to and from it
     int size = 5;
-    if (argc > 1) size = atoi(argv[1]);
+    bool dump_inputs = true;
+    uint64_t seed = matrix_rand_seed();
+    cl_tile_params params = {0, 0};
+    bool retune = false;
+    bool zero_copy = false;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--no-inputs") == 0) dump_inputs = false;
+        else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) seed = strtoull(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "--tile") == 0 && i + 1 < argc) params.tile = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--wpt") == 0 && i + 1 < argc) params.wpt = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--retune") == 0) retune = true;
+        else if (strcmp(argv[i], "--zero-copy") == 0) zero_copy = true;
+        else size = atoi(argv[i]);
+    }
 
     // get number of mpi nodes
     int np;
@@ -39,6 +73,27 @@ int main(int argc, char **argv) {
     int rank;
     MPI_Comm_rank(MPI_COMM_WORLD, &rank);
     
+    // every rank generates from rank 0's seed
+    MPI_Bcast(&seed, 1, MPI_UINT64_T, 0, MPI_COMM_WORLD);
+
+    // rank 0 tunes (or reads the cached tuning) for its device and every rank
+    // uses the result, so ranks are assumed to have the same kind of device
+    if (rank == 0) {
+        if (params.tile <= 0) params = cl_autotune(retune);
+        if (params.wpt <= 0 || params.tile % params.wpt != 0) params.wpt = 1;
+    }
+    MPI_Bcast(&params, 2, MPI_INT, 0, MPI_COMM_WORLD);
+
+    // bring up the opencl runtime and build (or load the cached binary of) the
+    // kernel before timing, it is reused by every cl_matrix_mul call
+    double t_setup = MPI_Wtime();
+    cl_runtime &rt = cl_runtime_get();
+    cl_runtime_kernel(rt, "matrix_mul.cl", cl_kernel_options(params).c_str(), "multiply_matrices_tiled");
+    t_setup = MPI_Wtime() - t_setup;
+
+    // 1d by rows, there is no --summa here yet: cl_matrix_mul overwrites c and
+    // reads it back on every call, where summa needs c to stay on the device and
+    // accumulate over panels
     // calculate send counts and displacements
     int send_counts[np] = {0};
     int displacements[np] = {0};
@@ -53,37 +108,38 @@ int main(int argc, char **argv) {
             send_counts[i] += size;
             rows_remainder--;
         }
-        if (i < size - 1)
+        if (i < np - 1)
             displacements[i + 1] = displacements[i] + send_counts[i];
     }    
 
     // define vars for matrix multiplication
-    int **a, **b, **c;
+    Matrix<elem_t> a, b, c;
     int my_row_count = send_counts[rank] / size;
+    int my_first_row = displacements[rank] / size;
 
     if (rank == 0) {
-        // init matrices
-        a = new_rand_matrix(size, size);
-        b = new_rand_matrix(size, size);
+        // init matrices, all of a is only needed when it is written to the output file
+        a = new_rand_matrix(dump_inputs ? size : my_row_count, size, seed, MATRIX_STREAM_A, 0);
+        b = new_rand_matrix(size, size, seed, MATRIX_STREAM_B, 0);
         c = new_zero_matrix(size, size);
 
         // start timing
         high_resolution_clock::time_point t_start = high_resolution_clock::now();
 
-        // broadcast (send) b
-        MPI_Bcast(b[0], size*size, MPI_INT, 0, MPI_COMM_WORLD);
-        MPI_Barrier(MPI_COMM_WORLD);
-
-        // scatter (send) a
-        MPI_Scatterv(a[0], send_counts, displacements, MPI_INT, MPI_IN_PLACE, send_counts[rank], MPI_INT, 0, MPI_COMM_WORLD);
-        MPI_Barrier(MPI_COMM_WORLD);
+        // broadcast (send) b, the collectives synchronise so no barriers are needed between phases
+        double t_phase = MPI_Wtime();
+        MPI_Bcast(b.data(), size*size, MPI_ELEM, 0, MPI_COMM_WORLD);
+        double t_bcast = MPI_Wtime();
 
         // matrix multiplication
-        cl_matrix_mul(a, b, c, my_row_count, size);
+        cl_mul_times cl_times;
+        cl_matrix_mul(a, b, c, my_row_count, size, params, zero_copy, &cl_times);
 
         // gather (receive) c
-        MPI_Gatherv(MPI_IN_PLACE, send_counts[rank], MPI_INT, c[0], send_counts, displacements, MPI_INT, 0, MPI_COMM_WORLD);
-        MPI_Barrier(MPI_COMM_WORLD);
+        double t_computed = MPI_Wtime();
+        MPI_Gatherv(MPI_IN_PLACE, send_counts[rank], MPI_ELEM, c.data(), send_counts, displacements, MPI_ELEM, 0, MPI_COMM_WORLD);
+        double phases[7] = {t_bcast - t_phase, t_computed - t_bcast, MPI_Wtime() - t_computed, t_setup,
+                            cl_times.upload, cl_times.kernel, cl_times.download};
 
         // stop timing
         high_resolution_clock::time_point t_stop = high_resolution_clock::now();
@@ -91,250 +147,322 @@ int main(int argc, char **argv) {
         // calculate execution time
         duration<double> exec_time = duration_cast<duration<double>>(t_stop - t_start);
 
+        // slowest rank per phase
+        double slowest[7];
+        MPI_Reduce(phases, slowest, 7, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+
         // open file for output
         ofstream fh;
         fh.open("mm-mpi-cl_result.txt");
 
-        // print matrix a
-        fh << "Matrix A:" << endl;
-        for (int row = 0; row < size; row++) 
-        for (int col = 0; col < size; col++)
-            fh << a[row][col] << (col < size - 1 ? "," : "\n");
-
-        // print matrix b
-        fh << "Matrix B:" << endl;
-        for (int row = 0; row < size; row++) 
-        for (int col = 0; col < size; col++)
-            fh << b[row][col] << (col < size - 1 ? "," : "\n");
-
-        // print matrix c
-        fh << "Product:" << endl;
-        for (int row = 0; row < size; row++) 
-        for (int col = 0; col < size; col++)
-            fh << c[row][col] << (col < size - 1 ? "," : "\n");
+        // write matrices a, b and c as binary records, tools/mm-convert turns them back into csv
+        int mh = open_matrix_file("mm-mpi-cl_result.mat");
+        bool written = mh >= 0;
+        if (written && dump_inputs) written = write_matrix(mh, a, "Matrix A") && write_matrix(mh, b, "Matrix B");
+        if (written) written = write_matrix(mh, c, "Product");
+        if (!written) perror("mm-mpi-cl_result.mat");
+        if (mh >= 0) close(mh);
 
         // print stats
         fh << "Input Size:\t" << size << "\nElapsed Time:\t" << exec_time.count() << endl;
         cout << "Input Size:\t" << size << "\nElapsed Time:\t" << exec_time.count() << endl;
+        fh << "Broadcast Time:\t" << slowest[0] << "\nCompute Time:\t" << slowest[1] << "\nGather Time:\t" << slowest[2] << endl;
+        cout << "Broadcast Time:\t" << slowest[0] << "\nCompute Time:\t" << slowest[1] << "\nGather Time:\t" << slowest[2] << endl;
+        fh << "  Upload Time:\t" << slowest[4] << "\n  Kernel Time:\t" << slowest[5] << "\n  Download Time:\t" << slowest[6] << endl;
+        cout << "  Upload Time:\t" << slowest[4] << "\n  Kernel Time:\t" << slowest[5] << "\n  Download Time:\t" << slowest[6] << endl;
+        fh << "Transfers:\t" << (zero_copy ? "zero copy" : "copy") << endl;
+        cout << "Transfers:\t" << (zero_copy ? "zero copy" : "copy") << endl;
+        fh << "OpenCL Setup Time:\t" << slowest[3] << "\nPrograms Built:\t" << rt.source_builds << "\nPrograms Cached:\t" << rt.cache_loads
+            << "\nPrograms Saved:\t" << rt.cache_saves << endl;
+        cout << "OpenCL Setup Time:\t" << slowest[3] << "\nPrograms Built:\t" << rt.source_builds << "\nPrograms Cached:\t" << rt.cache_loads
+            << "\nPrograms Saved:\t" << rt.cache_saves << endl;
+        fh << "Tile:\t" << params.tile << " x " << params.tile << ", " << params.wpt << " per work-item" << endl;
+        cout << "Tile:\t" << params.tile << " x " << params.tile << ", " << params.wpt << " per work-item" << endl;
+        fh << "Seed:\t" << seed << endl;
+        cout << "Seed:\t" << seed << endl;
 
         fh.close();
-
-        free_matrix(a);
-        free_matrix(b);
-        free_matrix(c);
     }
     else {
-        // init matrices
-        a = new_matrix(my_row_count, size);
-        b = new_matrix(size, size);
+        // init matrices, this rank's rows of a are generated locally instead of scattered
+        a = new_rand_matrix(my_row_count, size, seed, MATRIX_STREAM_A, my_first_row);
+        b = Matrix<elem_t>(size, size);
         c = new_zero_matrix(my_row_count, size);
 
-        // broadcast (receive) b
-        MPI_Bcast(b[0], size*size, MPI_INT, 0, MPI_COMM_WORLD);
-        MPI_Barrier(MPI_COMM_WORLD);
-
-        // scatter (receive) a
-        MPI_Scatterv(a[0], send_counts, displacements, MPI_INT, a[0], send_counts[rank], MPI_INT, 0, MPI_COMM_WORLD);
-        MPI_Barrier(MPI_COMM_WORLD);
+        // broadcast (receive) b, the collectives synchronise so no barriers are needed between phases
+        double t_phase = MPI_Wtime();
+        MPI_Bcast(b.data(), size*size, MPI_ELEM, 0, MPI_COMM_WORLD);
+        double t_bcast = MPI_Wtime();
 
         // matrix multiplication
-        cl_matrix_mul(a, b, c, my_row_count, size);
+        cl_mul_times cl_times;
+        cl_matrix_mul(a, b, c, my_row_count, size, params, zero_copy, &cl_times);
 
         // gather (send) c
-        MPI_Gatherv(c[0], send_counts[rank], MPI_INT, c[0], send_counts, displacements, MPI_INT, 0, MPI_COMM_WORLD);
-        MPI_Barrier(MPI_COMM_WORLD);
-
-        // clean up memory
-        free_matrix(a);
-        free_matrix(b);
-        free_matrix(c);
+        double t_computed = MPI_Wtime();
+        MPI_Gatherv(c.data(), send_counts[rank], MPI_ELEM, c.data(), send_counts, displacements, MPI_ELEM, 0, MPI_COMM_WORLD);
+        double phases[7] = {t_bcast - t_phase, t_computed - t_bcast, MPI_Wtime() - t_computed, t_setup,
+                            cl_times.upload, cl_times.kernel, cl_times.download};
+
+        // slowest rank per phase
+        double slowest[7];
+        MPI_Reduce(phases, slowest, 7, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
     }
 
+    cl_runtime_shutdown();
     MPI_Finalize();
 
     return 0;
 }
 
-int** new_matrix(int rows, int cols) {
+Matrix<elem_t> new_rand_matrix(int rows, int cols, uint64_t seed, uint32_t stream, int first_row) {
 
-    int** matrix = new int*[rows];
-    matrix[0] = new int[rows * cols];
-    for (int r = 1; r < rows; r++)
-        matrix[r] = &matrix[0][r*cols];
+    // rows [first_row, first_row + rows) of the counter-based matrix for this
+    // stream, identical whichever rank or thread generates them
+    Matrix<elem_t> matrix(rows, cols);
+    matrix_rand_fill(matrix, seed, stream, first_row, MAX_ELEMENT);
 
     return matrix;
 }
 
-int** new_rand_matrix(int rows, int cols) {
+Matrix<elem_t> new_zero_matrix(int rows, int cols) {
 
-    int** matrix = new_matrix(rows, cols);
-    for (int r = 0; r < rows; r++)
-    for (int c = 0; c < cols; c++)
-        matrix[r][c] = rand() % MAX_ELEMENT;
+    Matrix<elem_t> matrix(rows, cols);
+    matrix.fill(0);
 
     return matrix;
 }
 
-int** new_zero_matrix(int rows, int cols) {
-
-    int** matrix = new_matrix(rows, cols);
-    for (int r = 0; r < rows; r++)
-    for (int c = 0; c < cols; c++)
-        matrix[r][c] = 0;
-
-    return matrix;
+// build options for the tiled kernel
+string cl_kernel_options(const cl_tile_params &params) {
+    return string("-DELEM_T=") + matrix_type_name<elem_t>() + " -DTILE=" + to_string(params.tile) + " -DWPT=" + to_string(params.wpt);
 }
 
-void free_matrix(int** matrix) {
-    delete matrix[0];
-    delete matrix;
+// global size of the tiled kernel, rows and columns rounded up to whole tiles
+void cl_kernel_ranges(const cl_tile_params &params, size_t rows, size_t cols, size_t global[2], size_t local[2]) {
+
+    size_t tile = params.tile;
+    local[0] = tile;
+    local[1] = tile / params.wpt;
+    global[0] = (rows + tile - 1) / tile * tile;
+    global[1] = (cols + tile - 1) / tile * local[1];
 }
 
-void cl_matrix_mul(int** a, int** b, int** c, size_t rows, size_t cols) {
+// c = a * b for this rank's rows. transfers and the kernel are chained through
+// events on the in-order queue and the host only blocks once, on the last one.
+// with zero_copy the buffers wrap the matrices' own (64 byte aligned) storage
+// with CL_MEM_USE_HOST_PTR, nothing is uploaded and c is mapped rather than
+// read back, which on a cpu device means no copies at all.
+void cl_matrix_mul(const Matrix<elem_t> &a, const Matrix<elem_t> &b, Matrix<elem_t> &c, size_t rows, size_t cols,
+                   const cl_tile_params &params, bool zero_copy, cl_mul_times* times) {
 
     cl_int              err;
-    cl_device_id        device;
-    cl_context          context;
-    cl_program          program;
-    cl_command_queue    queue;
+    cl_runtime          &rt = cl_runtime_get();
     cl_kernel           kernel;
     cl_mem              buf_a, buf_b, buf_c;
-    cl_event            event = NULL;
-    const size_t        global[2] = {rows, cols};
-    const size_t        local[2] = {1, 1};
-
-    // create device
-    device = create_cl_device();
-
-    // create context
-    context = clCreateContext(NULL, 1, &device, NULL, NULL, &err);
-    if (err < 0) {
-        perror("Failed to create context. Exiting...\n");
-        exit(1);
+    cl_event            uploads[2] = {NULL, NULL};
+    cl_event            kernel_event = NULL, download = NULL;
+    size_t              global[2], local[2];
+    size_t              a_bytes = rows*cols*sizeof(elem_t), b_bytes = cols*cols*sizeof(elem_t);
+    int                 row_count = rows, col_count = cols;
+
+    // no rows on this rank (size < np): nothing to multiply, and opencl 1.x
+    // rejects both zero-byte buffers and an empty ndrange
+    times->upload = times->kernel = times->download = 0;
+    if (rows == 0) return;
+
+    cl_kernel_ranges(params, rows, cols, global, local);
+
+    // kernel built for the host element type and tiling, compiled once per process (or loaded from the binary cache)
+    string options = cl_kernel_options(params);
+    kernel = cl_runtime_kernel(rt, "matrix_mul.cl", options.c_str(), "multiply_matrices_tiled");
+
+    if (zero_copy) {
+        // host buffers are tied to these matrices, so they are not pooled
+        buf_a = clCreateBuffer(rt.context, CL_MEM_READ_ONLY | CL_MEM_USE_HOST_PTR, a_bytes, (void*)a.data(), &err);
+        if (err >= 0) buf_b = clCreateBuffer(rt.context, CL_MEM_READ_ONLY | CL_MEM_USE_HOST_PTR, b_bytes, (void*)b.data(), &err);
+        if (err >= 0) buf_c = clCreateBuffer(rt.context, CL_MEM_WRITE_ONLY | CL_MEM_USE_HOST_PTR, a_bytes, c.data(), &err);
+        if (err < 0) {
+            perror("Failed to create host buffers. Exiting...\n");
+            exit(1);
+        }
+    }
+    else {
+        // matrix buffers from the runtime's pool, written without blocking
+        buf_a = cl_runtime_buffer(rt, CL_MEM_READ_ONLY, a_bytes);
+        buf_b = cl_runtime_buffer(rt, CL_MEM_READ_ONLY, b_bytes);
+        buf_c = cl_runtime_buffer(rt, CL_MEM_WRITE_ONLY, a_bytes);
+
+        // the kernel writes every element of c so it is not uploaded
+        clEnqueueWriteBuffer(rt.queue, buf_a, CL_FALSE, 0, a_bytes, a.data(), 0, NULL, &uploads[0]);
+        clEnqueueWriteBuffer(rt.queue, buf_b, CL_FALSE, 0, b_bytes, b.data(), 0, NULL, &uploads[1]);
     }
 
-    // create program from source file
-    program = create_cl_program(context, device, "matrix_mul.cl");
-
-    // create command queue
-    queue = clCreateCommandQueueWithProperties(context, device, 0, &err);
-    if (err < 0) {
-        perror("Failed to create command queue. Exiting...\n");
+    // copy kernel args to device
+    err  = clSetKernelArg(kernel, 0, sizeof(int), (void*)&row_count);
+    err |= clSetKernelArg(kernel, 1, sizeof(int), (void*)&col_count);
+    err |= clSetKernelArg(kernel, 2, sizeof(cl_mem), (void*)&buf_a);
+    err |= clSetKernelArg(kernel, 3, sizeof(cl_mem), (void*)&buf_b);
+    err |= clSetKernelArg(kernel, 4, sizeof(cl_mem), (void*)&buf_c);
+    if (err != CL_SUCCESS) {
+        perror("Failed to copy kernel args. Exiting...\n");
         exit(1);
     }
 
-    // create kernel
-    kernel = clCreateKernel(program, "multiply_matrices", &err);
+    // execute matrix multiplication once the uploads are done
+    err = clEnqueueNDRangeKernel(rt.queue, kernel, 2, NULL, global, local, zero_copy ? 0 : 2, zero_copy ? NULL : uploads, &kernel_event);
     if (err < 0) {
-        perror("Failed to create kernel. Exiting...\n");
+        perror("Failed to enqueue kernel, try other --tile/--wpt values. Exiting...\n");
         exit(1);
     }
 
-    // create matrix buffers
-    buf_a = clCreateBuffer(context, CL_MEM_READ_ONLY,  rows*cols*sizeof(int), NULL, NULL);
-    buf_b = clCreateBuffer(context, CL_MEM_READ_ONLY,  cols*cols*sizeof(int), NULL, NULL);
-    buf_c = clCreateBuffer(context, CL_MEM_READ_ONLY,  rows*cols*sizeof(int), NULL, NULL);
-
-    // copy buffers to device
-    clEnqueueWriteBuffer(queue, buf_a, CL_TRUE, 0, rows*cols*sizeof(int), a[0], 0, NULL, NULL);
-    clEnqueueWriteBuffer(queue, buf_b, CL_TRUE, 0, cols*cols*sizeof(int), b[0], 0, NULL, NULL);
-    clEnqueueWriteBuffer(queue, buf_c, CL_TRUE, 0, rows*cols*sizeof(int), c[0], 0, NULL, NULL);
-
-    // copy kernel args to device
-    clSetKernelArg(kernel, 0, sizeof(int), (void*)&rows);
-    clSetKernelArg(kernel, 1, sizeof(int), (void*)&cols);
-    clSetKernelArg(kernel, 2, sizeof(cl_mem), (void*)&buf_a);
-    clSetKernelArg(kernel, 3, sizeof(cl_mem), (void*)&buf_b);
-    clSetKernelArg(kernel, 4, sizeof(cl_mem), (void*)&buf_c);
-    if(err < 0) {
-      perror("Failed to copy kernel args. Exiting...\n");
-      exit(1);
-   }
-
-    // execute matrix multiplication
-    clEnqueueNDRangeKernel(queue, kernel, 2, NULL, global, local, 0, NULL, &event);
-    clWaitForEvents(1, &event);
-    clEnqueueReadBuffer(queue, buf_c, CL_TRUE, 0, rows*cols*sizeof(int), c[0], 0, NULL, NULL);
-
-    // free memory
-    clReleaseKernel(kernel);
-    clReleaseMemObject(buf_a);
-    clReleaseMemObject(buf_b);
-    clReleaseMemObject(buf_c);
-    clReleaseCommandQueue(queue);
-    clReleaseProgram(program);
-    clReleaseContext(context);
-}
+    // bring c back after the kernel, mapping a host buffer makes the device's writes visible in c
+    if (zero_copy) {
+        void* mapped = clEnqueueMapBuffer(rt.queue, buf_c, CL_FALSE, CL_MAP_READ, 0, a_bytes, 1, &kernel_event, &download, &err);
+        if (err < 0) {
+            perror("Failed to map result buffer. Exiting...\n");
+            exit(1);
+        }
+        clWaitForEvents(1, &download);
+        clEnqueueUnmapMemObject(rt.queue, buf_c, mapped, 0, NULL, NULL);
+    }
+    else {
+        clEnqueueReadBuffer(rt.queue, buf_c, CL_FALSE, 0, a_bytes, c.data(), 1, &kernel_event, &download);
+        clWaitForEvents(1, &download);
+    }
 
-cl_device_id create_cl_device() {
-    
-    cl_int          err;
-    cl_platform_id  platform;
-    cl_device_id    device;
+    times->upload = cl_event_seconds(uploads[0]) + cl_event_seconds(uploads[1]);
+    times->kernel = cl_event_seconds(kernel_event);
+    times->download = cl_event_seconds(download);
 
-    err = clGetPlatformIDs(1, &platform, NULL);
-    if (err < 0) {
-        perror("Failed to identify a platform. Exiting...\n");
-        exit(1);
-    }
+    for (cl_event event : {uploads[0], uploads[1], kernel_event, download})
+        if (event != NULL) clReleaseEvent(event);
 
-    err = clGetDeviceIDs(platform, CL_DEVICE_TYPE_GPU, 1, &device, NULL);
-    if (err < 0) {
-        perror("Failed to access GPU device. Attempting CPU...\n");
-        err = clGetDeviceIDs(platform, CL_DEVICE_TYPE_CPU, 1, &device, NULL);
+    if (zero_copy) {
+        clFinish(rt.queue);
+        clReleaseMemObject(buf_a);
+        clReleaseMemObject(buf_b);
+        clReleaseMemObject(buf_c);
     }
-    if (err < 0) {
-        perror("Failed to access CPU device. No devices available. Exiting...\n");
-        exit(1);
+    else {
+        // buffers go back to the pool for the next call
+        cl_runtime_release(rt, buf_a);
+        cl_runtime_release(rt, buf_b);
+        cl_runtime_release(rt, buf_c);
     }
-
-    return device;
 }
 
-cl_program create_cl_program(cl_context context, cl_device_id device, const char* filename) {
-    
-    FILE        *fp;
-    char        *program_buffer, *program_log;
-    size_t      program_size, log_size;
-    cl_int      err;
-    cl_program  program;
-
-    fp = fopen(filename, "r");
-    if (fp == NULL) {
-        perror("Failed to open program file. Exiting...\n");
-        exit(1);
-    }
+// cache key for a tuning result, the device and driver plus the element type
+string cl_tune_key(cl_device_id device) {
 
-    fseek(fp, 0, SEEK_END);
-    program_size = ftell(fp);
-    rewind(fp);
+    string key = cl_device_string(device, CL_DEVICE_NAME) + "|" + cl_device_string(device, CL_DRIVER_VERSION) +
+                 "|" + matrix_type_name<elem_t>();
+    for (char &ch : key) if (ch == '\t' || ch == '\n') ch = ' ';
+    return key;
+}
 
-    program_buffer = (char*)malloc(program_size + 1);
-    program_buffer[program_size] = '\0';
-    fread(program_buffer, sizeof(char), program_size, fp);
-    fclose(fp);
+// time every tile x wpt that fits the device on a TUNE_SIZE square product
+// and keep the fastest. results are cached in TUNE_FILE per device, one
+// "key<tab>tile<tab>wpt" line each, and reused unless retune is set.
+cl_tile_params cl_autotune(bool retune) {
 
-    program = clCreateProgramWithSource(context, 1, (const char**)&program_buffer, &program_size, &err);
-    if (err < 0) {
-        perror("Failed to create program. Exiting...\n");
-        exit(1);
-    }
-    free(program_buffer);
+    const int       tiles[] = {8, 16, 32};
+    const int       wpts[] = {1, 2, 4, 8};
+    cl_tile_params  best = {16, 4};
+    double          best_time = -1;
+    bool            cached = false;
+    cl_int          err;
 
-    err = clBuildProgram(program, 0, NULL, NULL, NULL, NULL);
-    if (err < 0) {
-        clGetProgramBuildInfo(program, device, CL_PROGRAM_BUILD_LOG, 0, NULL, &log_size);
-        
-        program_log = (char*)malloc(log_size + 1);
-        program_log[log_size] = '\0';
-        
-        clGetProgramBuildInfo(program, device, CL_PROGRAM_BUILD_LOG, log_size + 1, program_log, NULL);
-        
-        printf("%s\n", program_log);
-        
-        free(program_log);
-        exit(1);
+    cl_runtime &rt = cl_runtime_get();
+    string key = cl_tune_key(rt.device);
+
+    // cached result, the last line for this device wins
+    ifstream cache(TUNE_FILE);
+    string line;
+    while (!retune && getline(cache, line)) {
+        size_t tab = line.find('\t');
+        if (tab == string::npos || line.compare(0, tab, key) != 0) continue;
+        cl_tile_params entry = {0, 0};
+        if (sscanf(line.c_str() + tab + 1, "%d\t%d", &entry.tile, &entry.wpt) == 2 && entry.tile > 0) {
+            best = entry;
+            cached = true;
+        }
+    }
+    cache.close();
+    if (cached) return best;
+
+    size_t max_group = 0;
+    cl_ulong local_mem = 0;
+    clGetDeviceInfo(rt.device, CL_DEVICE_MAX_WORK_GROUP_SIZE, sizeof(max_group), &max_group, NULL);
+    clGetDeviceInfo(rt.device, CL_DEVICE_LOCAL_MEM_SIZE, sizeof(local_mem), &local_mem, NULL);
+
+    // contents do not matter for timing, zeros avoid denormals in float builds. the
+    // pooled buffers are large enough for the real product when size <= TUNE_SIZE
+    size_t bytes = (size_t)TUNE_SIZE * TUNE_SIZE * sizeof(elem_t);
+    Matrix<elem_t> zeros = new_zero_matrix(TUNE_SIZE, TUNE_SIZE);
+    cl_mem buf_a = cl_runtime_buffer(rt, CL_MEM_READ_ONLY, bytes);
+    cl_mem buf_b = cl_runtime_buffer(rt, CL_MEM_READ_ONLY, bytes);
+    cl_mem buf_c = cl_runtime_buffer(rt, CL_MEM_WRITE_ONLY, bytes);
+    clEnqueueWriteBuffer(rt.queue, buf_a, CL_TRUE, 0, bytes, zeros.data(), 0, NULL, NULL);
+    clEnqueueWriteBuffer(rt.queue, buf_b, CL_TRUE, 0, bytes, zeros.data(), 0, NULL, NULL);
+    int n = TUNE_SIZE;
+
+    cout << "Tuning " << key << " (" << TUNE_SIZE << " x " << TUNE_SIZE << ")" << endl;
+
+    for (int tile : tiles)
+    for (int wpt : wpts) {
+        cl_tile_params params = {tile, wpt};
+        size_t group = tile * tile / wpt;
+        if (wpt > tile || group > max_group || 2 * tile * tile * sizeof(elem_t) > local_mem) continue;
+
+        // every candidate stays built in the runtime, and in the binary cache for later runs
+        string options = cl_kernel_options(params);
+        cl_kernel kernel = cl_runtime_kernel(rt, "matrix_mul.cl", options.c_str(), "multiply_matrices_tiled");
+
+        size_t kernel_group = 0;
+        clGetKernelWorkGroupInfo(kernel, rt.device, CL_KERNEL_WORK_GROUP_SIZE, sizeof(kernel_group), &kernel_group, NULL);
+        err = CL_SUCCESS;
+
+        if (kernel_group >= group) {
+            size_t global[2], local[2];
+            cl_kernel_ranges(params, n, n, global, local);
+            clSetKernelArg(kernel, 0, sizeof(int), (void*)&n);
+            clSetKernelArg(kernel, 1, sizeof(int), (void*)&n);
+            clSetKernelArg(kernel, 2, sizeof(cl_mem), (void*)&buf_a);
+            clSetKernelArg(kernel, 3, sizeof(cl_mem), (void*)&buf_b);
+            clSetKernelArg(kernel, 4, sizeof(cl_mem), (void*)&buf_c);
+
+            // one untimed warm-up run, then the fastest of TUNE_RUNS
+            double time = -1;
+            for (int run = 0; run <= TUNE_RUNS && err >= 0; run++) {
+                cl_event event;
+                err = clEnqueueNDRangeKernel(rt.queue, kernel, 2, NULL, global, local, 0, NULL, &event);
+                if (err < 0) break;
+                clWaitForEvents(1, &event);
+                double t = cl_event_seconds(event);
+                clReleaseEvent(event);
+
+                if (run > 0 && (time < 0 || t < time)) time = t;
+            }
+
+            if (err >= 0 && time > 0) {
+                cout << "  Tile " << tile << ", WPT " << wpt << ":\t" << time << " s\t("
+                     << 2.0 * n * n * n / time / 1e9 << " GFLOP/s)" << endl;
+                if (best_time < 0 || time < best_time) {
+                    best = params;
+                    best_time = time;
+                }
+            }
+        }
     }
 
-    return program;
-}
\ No newline at end of file
+    cl_runtime_release(rt, buf_a);
+    cl_runtime_release(rt, buf_b);
+    cl_runtime_release(rt, buf_c);
+
+    if (best_time > 0) {
+        ofstream out(TUNE_FILE, ios::app);
+        out << key << "\t" << best.tile << "\t" << best.wpt << endl;
+    }
+    return best;
+}
@@ -1,59 +1,337 @@
 #include <iostream>
 #include <fstream>
 #include <chrono>
+#include <string.h>
 #include <mpi.h>
 #include <omp.h>
 #include <thread>
+#include <vector>
+#include "../../../common/matrix.h"
+#include "../../../common/matrix_mpi.h"
+#include "../../../common/matrix_io.h"
+#include "../../../common/matrix_rand.h"
+#include "../../../common/gemm.h"
+#include "../../../common/strassen.h"
+#include "../../../common/summa.h"
+#include "../../../common/row_pipeline.h"
+#include "../../../common/placement.h"
 
 using namespace std;
 using namespace chrono;
 
 #define MAX_ELEMENT 20
 
-int** new_matrix(int rows, int cols) {
+Matrix<elem_t> new_rand_matrix(int rows, int cols, uint64_t seed, uint32_t stream, int first_row) {
 
-    int** matrix = new int*[rows];
-    matrix[0] = new int[rows * cols];
-    for (int r = 1; r < rows; r++)
-        matrix[r] = &matrix[0][r*cols];
+    // rows [first_row, first_row + rows) of the counter-based matrix for this
+    // stream, identical whichever rank or thread generates them
+    Matrix<elem_t> matrix(rows, cols);
+    matrix_rand_fill(matrix, seed, stream, first_row, MAX_ELEMENT);
 
     return matrix;
 }
 
-int** new_rand_matrix(int rows, int cols) {
-
-    int** matrix = new_matrix(rows, cols);
-    for (int r = 0; r < rows; r++)
-    for (int c = 0; c < cols; c++)
-        matrix[r][c] = rand() % MAX_ELEMENT;
+// Every omp loop over a rank's matrices walks the tiles of one gemm_partition,
+// the split of this rank's block of c, with tile t on thread t: generating a
+// and b, zeroing c and the multiply. So each tile of c is first touched by, and
+// placed on the numa node of, the thread that computes it, a's row tiles by the
+// threads that read those rows and b's column tiles by the threads that read
+// those columns.
+
+// the block at (first_row, first_col) of the counter-based matrix for this
+// stream, generated in part's grid
+Matrix<elem_t> new_rand_tiles(int rows, int cols, uint64_t seed, uint32_t stream, int first_row, int first_col,
+                              const gemm_partition &part, int threads) {
+
+    Matrix<elem_t> matrix(rows, cols);
+    gemm_partition grid = gemm_partition_resize(part, rows, cols);
+
+    #pragma omp parallel for num_threads(threads) schedule(static)
+    for (int t = 0; t < gemm_partition_tiles(grid); t++) {
+        gemm_range tile = gemm_partition_tile(grid, t);
+        matrix_rand_tile(matrix, seed, stream, first_row, first_col, tile.row_start, tile.row_end,
+                         tile.col_start, tile.col_end, MAX_ELEMENT);
+    }
 
     return matrix;
 }
 
-int** new_zero_matrix(int rows, int cols) {
+// zero the tiles of part in c, rows of c past part.m are left alone
+void zero_tiles(Matrix<elem_t> &c, const gemm_partition &part, int threads) {
+
+    #pragma omp parallel for num_threads(threads) schedule(static)
+    for (int t = 0; t < gemm_partition_tiles(part); t++) {
+        gemm_range tile = gemm_partition_tile(part, t);
+        for (int row = tile.row_start; row < tile.row_end; row++)
+            memset(c[row] + tile.col_start, 0, (size_t)(tile.col_end - tile.col_start) * sizeof(elem_t));
+    }
+}
 
-    int** matrix = new_matrix(rows, cols);
-    for (int r = 0; r < rows; r++)
-    for (int c = 0; c < cols; c++)
-        matrix[r][c] = 0;
+Matrix<elem_t> new_zero_matrix(int rows, int cols, const gemm_partition &part, int threads) {
 
+    Matrix<elem_t> matrix(rows, cols);
+    zero_tiles(matrix, part, threads);
     return matrix;
 }
 
-void free_matrix(int** matrix) {
-    delete matrix[0];
-    delete matrix;
+// the tiles of part in c += a * b
+void multiply_tiles(const Matrix<elem_t> &a, const Matrix<elem_t> &b, Matrix<elem_t> &c, const gemm_partition &part, int threads) {
+
+    #pragma omp parallel for shared(a, b, c, part) num_threads(threads) schedule(static)
+    for (int t = 0; t < gemm_partition_tiles(part); t++) {
+        gemm_range tile = gemm_partition_tile(part, t);
+        gemm_tile(a, b, c, tile.row_start, tile.row_end, tile.col_start, tile.col_end);
+    }
+}
+
+// summa and pipeline panel kernel, the m x n c split into one tile per omp
+// thread. for summa that is the rank's whole block, the partition c was zeroed in
+void omp_panel_kernel(const elem_t* a, int lda, const elem_t* b, int ldb, elem_t* c, int ldc, int m, int k, int n, void* ctx) {
+
+    int threads = *(int*)ctx;
+    gemm_partition part = gemm_partition_create(m, n, threads);
+
+    #pragma omp parallel for num_threads(threads) schedule(static)
+    for (int t = 0; t < gemm_partition_tiles(part); t++) {
+        gemm_range tile = gemm_partition_tile(part, t);
+        gemm_tile(a, lda, b, ldb, c, ldc, k, tile.row_start, tile.row_end, tile.col_start, tile.col_end);
+    }
+}
+
+// 2d summa: every rank generates and keeps only its blocks of a, b and c, and
+// panels of a and b are broadcast along grid rows and columns. only the
+// checksum of c is reduced, plus c itself when gather_c is set.
+void run_summa(int size, uint64_t seed, int panel, bool gather_c, bool dump_inputs, int threads) {
+
+    summa_grid grid = summa_grid_create(MPI_COMM_WORLD);
+    int rank;
+    MPI_Comm_rank(grid.comm, &rank);
+
+    // square problem, so the blocks of a, b and c all have the same shape
+    int my_rows = summa_block_size(size, grid.rows, grid.row);
+    int my_cols = summa_block_size(size, grid.cols, grid.col);
+    int first_row = summa_block_start(size, grid.rows, grid.row);
+    int first_col = summa_block_start(size, grid.cols, grid.col);
+
+    MPI_Barrier(grid.comm);
+    double t_start = MPI_Wtime();
+
+    gemm_partition part = gemm_partition_create(my_rows, my_cols, threads);
+    Matrix<elem_t> a = new_rand_tiles(my_rows, my_cols, seed, MATRIX_STREAM_A, first_row, first_col, part, threads);
+    Matrix<elem_t> b = new_rand_tiles(my_rows, my_cols, seed, MATRIX_STREAM_B, first_row, first_col, part, threads);
+    Matrix<elem_t> c = new_zero_matrix(my_rows, my_cols, part, threads);
+    double t_generated = MPI_Wtime();
+
+    summa_times times;
+    summa(grid, size, size, size, a, b, c, panel, omp_panel_kernel, &threads, &times);
+    double t_computed = MPI_Wtime();
+
+    uint64_t my_checksum = matrix_block_checksum(c, first_row, first_col, size);
+    uint64_t checksum = 0;
+    MPI_Reduce(&my_checksum, &checksum, 1, MPI_UINT64_T, MPI_SUM, 0, grid.comm);
+
+    Matrix<elem_t> product;
+    if (gather_c) summa_gather(grid, size, size, c, product);
+    double t_stop = MPI_Wtime();
+
+    // slowest rank per phase
+    double phases[6] = {t_stop - t_start, t_generated - t_start, t_computed - t_generated,
+                        times.compute, times.wait, t_stop - t_computed};
+    double slowest[6];
+    MPI_Reduce(phases, slowest, 6, MPI_DOUBLE, MPI_MAX, 0, grid.comm);
+
+    if (rank == 0) {
+        // inputs are regenerated from the seed for the output file, outside the timed region
+        if (gather_c) {
+            int mh = open_matrix_file("mm-mpi-omp_result.mat");
+            bool written = mh >= 0;
+            if (written && dump_inputs) {
+                written = write_matrix(mh, new_rand_matrix(size, size, seed, MATRIX_STREAM_A, 0), "Matrix A") &&
+                          write_matrix(mh, new_rand_matrix(size, size, seed, MATRIX_STREAM_B, 0), "Matrix B");
+            }
+            if (written) written = write_matrix(mh, product, "Product");
+            if (!written) perror("mm-mpi-omp_result.mat");
+            if (mh >= 0) close(mh);
+        }
+
+        ofstream fh;
+        fh.open("mm-mpi-omp_result.txt");
+
+        char checksum_hex[17];
+        snprintf(checksum_hex, sizeof(checksum_hex), "%016llx", (unsigned long long)checksum);
+
+        for (ostream* out : {(ostream*)&fh, (ostream*)&cout}) {
+            *out << "Input Size:\t" << size << "\nElapsed Time:\t" << slowest[0] << endl;
+            *out << "Grid:\t" << grid.rows << " x " << grid.cols << "\nPanel:\t" << panel << endl;
+            *out << "Threads:\t" << threads << endl;
+            *out << "Generate Time:\t" << slowest[1] << "\nSUMMA Time:\t" << slowest[2] << endl;
+            *out << "  Compute Time:\t" << slowest[3] << "\n  Broadcast Wait:\t" << slowest[4] << endl;
+            *out << (gather_c ? "Gather Time:\t" : "Reduce Time:\t") << slowest[5] << endl;
+            *out << "Product Checksum:\t" << checksum_hex << endl;
+            *out << "Seed:\t" << seed << endl;
+        }
+
+        fh.close();
+    }
+
+    summa_grid_free(&grid);
+}
+
+// rank 0 streams a to the other ranks in chunks of rows, each chunk is
+// multiplied as soon as it arrives and its rows of c are sent straight back
+void run_pipeline(int size, int rank, uint64_t seed, int chunk, bool dump_inputs, int threads) {
+
+    Matrix<elem_t> a, b, c;
+    if (rank == 0) {
+        a = new_rand_matrix(size, size, seed, MATRIX_STREAM_A, 0);
+        b = new_rand_matrix(size, size, seed, MATRIX_STREAM_B, 0);
+        c = Matrix<elem_t>(size, size);
+    }
+
+    MPI_Barrier(MPI_COMM_WORLD);
+    double t_start = MPI_Wtime();
+
+    pipeline_times times;
+    pipeline_multiply(MPI_COMM_WORLD, size, chunk, a, b, c, omp_panel_kernel, &threads, &times);
+    double t_stop = MPI_Wtime();
+
+    // slowest rank per phase
+    double phases[5] = {t_stop - t_start, times.bcast, times.a_wait, times.compute, times.c_wait};
+    double slowest[5];
+    MPI_Reduce(phases, slowest, 5, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+
+    if (rank != 0) return;
+
+    int mh = open_matrix_file("mm-mpi-omp_result.mat");
+    bool written = mh >= 0;
+    if (written && dump_inputs) written = write_matrix(mh, a, "Matrix A") && write_matrix(mh, b, "Matrix B");
+    if (written) written = write_matrix(mh, c, "Product");
+    if (!written) perror("mm-mpi-omp_result.mat");
+    if (mh >= 0) close(mh);
+
+    ofstream fh;
+    fh.open("mm-mpi-omp_result.txt");
+
+    char checksum_hex[17];
+    snprintf(checksum_hex, sizeof(checksum_hex), "%016llx", (unsigned long long)matrix_sum_checksum(c, 0));
+
+    // communication that was not hidden behind the slowest rank's compute
+    double exposed = slowest[0] - slowest[3];
+
+    for (ostream* out : {(ostream*)&fh, (ostream*)&cout}) {
+        *out << "Input Size:\t" << size << "\nElapsed Time:\t" << slowest[0] << endl;
+        *out << "Chunk Rows:\t" << chunk << endl;
+        *out << "Threads:\t" << threads << endl;
+        *out << "Broadcast Time:\t" << slowest[1] << "\nA Wait Time:\t" << slowest[2] << endl;
+        *out << "Compute Time:\t" << slowest[3] << "\nC Wait Time:\t" << slowest[4] << endl;
+        *out << "Exposed Communication:\t" << (exposed > 0 ? exposed : 0) << endl;
+        *out << "Product Checksum:\t" << checksum_hex << endl;
+        *out << "Seed:\t" << seed << endl;
+    }
+
+    fh.close();
+}
+
+// print every rank's cpus and numa nodes on rank 0, in rank order
+void report_placement(const node_placement &placement, bool pinned, int threads, int rank, int np) {
+
+    char line[256];
+    if (pinned) snprintf(line, sizeof(line), "%s", placement_describe(placement).c_str());
+    else snprintf(line, sizeof(line), "node rank %d/%d, %d threads unpinned", placement.node_rank, placement.node_size, threads);
+
+    vector<char> lines(rank == 0 ? sizeof(line) * np : 0);
+    MPI_Gather(line, sizeof(line), MPI_CHAR, lines.data(), sizeof(line), MPI_CHAR, 0, MPI_COMM_WORLD);
+
+    if (rank == 0) {
+        for (int p = 0; p < np; p++)
+            cout << "Rank " << p << " Placement:\t" << &lines[p * sizeof(line)] << endl;
+    }
+}
+
+// time this rank's rows of the 1d product with the old placement (one
+// unpinned thread per hardware thread on every rank, c zeroed by one thread)
+// and then with the node-local one (pinned threads, a, b and c first touched
+// in the compute tiles). both multiply in one tile per thread.
+// the second set of matrices is allocated while the first is still live so
+// the allocator cannot hand back pages that were already touched.
+void compare_placement(int size, int rank, int np, uint64_t seed, const node_placement &placement) {
+
+    int my_rows = summa_block_size(size, np, rank);
+    int my_first_row = summa_block_start(size, np, rank);
+    int old_threads = thread::hardware_concurrency();
+    int threads = placement_threads(placement);
+    double flops = 2.0 * size * size * size;
+
+    omp_set_num_threads(old_threads);
+    Matrix<elem_t> a0 = new_rand_matrix(my_rows, size, seed, MATRIX_STREAM_A, my_first_row);
+    Matrix<elem_t> b0 = new_rand_matrix(size, size, seed, MATRIX_STREAM_B, 0);
+    Matrix<elem_t> c0(my_rows, size);
+    c0.fill(0);
+
+    MPI_Barrier(MPI_COMM_WORLD);
+    double t_start = MPI_Wtime();
+    multiply_tiles(a0, b0, c0, gemm_partition_create(my_rows, size, old_threads), old_threads);
+    double times[2] = {MPI_Wtime() - t_start, 0};
+
+    placement_pin_threads(placement);
+    gemm_partition part = gemm_partition_create(my_rows, size, threads);
+    Matrix<elem_t> a1 = new_rand_tiles(my_rows, size, seed, MATRIX_STREAM_A, my_first_row, 0, part, threads);
+    Matrix<elem_t> b1 = new_rand_tiles(size, size, seed, MATRIX_STREAM_B, 0, 0, part, threads);
+    Matrix<elem_t> c1 = new_zero_matrix(my_rows, size, part, threads);
+
+    MPI_Barrier(MPI_COMM_WORLD);
+    t_start = MPI_Wtime();
+    multiply_tiles(a1, b1, c1, part, threads);
+    times[1] = MPI_Wtime() - t_start;
+
+    // all ranks multiply at once, so throughput is set by the slowest
+    double slowest[2];
+    MPI_Reduce(times, slowest, 2, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+
+    if (rank == 0) {
+        cout << "Unpinned Compute:\t" << slowest[0] << "\t(" << flops / slowest[0] / 1e9 << " GFLOP/s, "
+             << old_threads << " threads per rank)" << endl;
+        cout << "Pinned Compute:\t" << slowest[1] << "\t(" << flops / slowest[1] / 1e9 << " GFLOP/s, "
+             << threads << " threads on rank 0)" << endl;
+        cout << "Placement Speedup:\t" << slowest[0] / slowest[1] << endl;
+    }
 }
 
 int main(int argc, char **argv) {
     
     MPI_Init(&argc, &argv);
     
-    //srand(time(NULL));
-
-    // get matrix size (rows, cols)
+    // get matrix size (rows, cols), --strassen or --crossover N selects strassen-winograd,
+    // --no-inputs writes only the product, --seed N reproduces the inputs of an earlier run,
+    // --summa multiplies on a 2d grid with panels of --panel N and reduces only a checksum of c
+    // (--gather also collects c), --pipeline streams a out and c back in chunks of --chunk N rows,
+    // overlapping both with compute. threads are pinned to this rank's share of its node's cpus
+    // unless --no-pin is given, --compare-placement first times the multiply both ways
     int size = 5;
-    if (argc > 1) size = atoi(argv[1]);
+    int crossover = 0;
+    bool dump_inputs = true;
+    uint64_t seed = matrix_rand_seed();
+    bool use_summa = false;
+    bool gather_c = false;
+    int panel = SUMMA_PANEL;
+    bool pipeline = false;
+    int chunk = PIPELINE_CHUNK;
+    bool pin = true;
+    bool compare = false;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--no-inputs") == 0) dump_inputs = false;
+        else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) seed = strtoull(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "--summa") == 0) use_summa = true;
+        else if (strcmp(argv[i], "--gather") == 0) gather_c = true;
+        else if (strcmp(argv[i], "--panel") == 0 && i + 1 < argc) panel = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--pipeline") == 0) pipeline = true;
+        else if (strcmp(argv[i], "--chunk") == 0 && i + 1 < argc) chunk = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--no-pin") == 0) pin = false;
+        else if (strcmp(argv[i], "--compare-placement") == 0) compare = true;
+        else if (strcmp(argv[i], "--strassen") == 0 && crossover == 0) crossover = STRASSEN_CROSSOVER;
+        else if (strcmp(argv[i], "--crossover") == 0 && i + 1 < argc) crossover = atoi(argv[++i]);
+        else size = atoi(argv[i]);
+    }
 
     // get number of mpi nodes
     int np;
@@ -63,6 +341,30 @@ int main(int argc, char **argv) {
     int rank;
     MPI_Comm_rank(MPI_COMM_WORLD, &rank);
     
+    // every rank generates from rank 0's seed
+    MPI_Bcast(&seed, 1, MPI_UINT64_T, 0, MPI_COMM_WORLD);
+
+    // ranks on the same node split its cores instead of each starting one thread per core
+    node_placement placement = placement_create(MPI_COMM_WORLD);
+    if (compare) compare_placement(size, rank, np, seed, placement);
+
+    int threads = pin ? placement_threads(placement) : thread::hardware_concurrency();
+    if (pin) placement_pin_threads(placement);
+    else omp_set_num_threads(threads);
+    report_placement(placement, pin, threads, rank, np);
+
+    if (pipeline) {
+        run_pipeline(size, rank, seed, chunk > 0 ? chunk : PIPELINE_CHUNK, dump_inputs, threads);
+        MPI_Finalize();
+        return 0;
+    }
+
+    if (use_summa) {
+        run_summa(size, seed, panel > 0 ? panel : SUMMA_PANEL, gather_c, dump_inputs, threads);
+        MPI_Finalize();
+        return 0;
+    }
+
     // calculate send counts and displacements
     int send_counts[np] = {0};
     int displacements[np] = {0};
@@ -77,42 +379,39 @@ int main(int argc, char **argv) {
             send_counts[i] += size;
             rows_remainder--;
         }
-        if (i < size - 1)
+        if (i < np - 1)
             displacements[i + 1] = displacements[i] + send_counts[i];
     }    
 
     // define vars for matrix multiplication
-    int **a, **b, **c;
+    Matrix<elem_t> a, b, c;
     int my_row_count = send_counts[rank] / size;
+    int my_first_row = displacements[rank] / size;
+    gemm_partition part = gemm_partition_create(my_row_count, size, threads);
 
     if (rank == 0) {
-        // init matrices
-        a = new_rand_matrix(size, size);
-        b = new_rand_matrix(size, size);
-        c = new_zero_matrix(size, size);
+        // init matrices in this rank's compute tiles, the other ranks' rows of c are gathered into place
+        a = new_rand_tiles(my_row_count, size, seed, MATRIX_STREAM_A, 0, 0, part, threads);
+        b = new_rand_tiles(size, size, seed, MATRIX_STREAM_B, 0, 0, part, threads);
+        c = Matrix<elem_t>(size, size);
+        zero_tiles(c, part, threads);
 
         // start timing
         high_resolution_clock::time_point t_start = high_resolution_clock::now();
 
-        // broadcast (send) b
-        MPI_Bcast(b[0], size*size, MPI_INT, 0, MPI_COMM_WORLD);
-        MPI_Barrier(MPI_COMM_WORLD);
-
-        // scatter (send) a
-        MPI_Scatterv(a[0], send_counts, displacements, MPI_INT, MPI_IN_PLACE, send_counts[rank], MPI_INT, 0, MPI_COMM_WORLD);
-        MPI_Barrier(MPI_COMM_WORLD);
+        // broadcast (send) b, the collectives synchronise so no barriers are needed between phases
+        double t_phase = MPI_Wtime();
+        MPI_Bcast(b.data(), size*size, MPI_ELEM, 0, MPI_COMM_WORLD);
+        double t_bcast = MPI_Wtime();
 
         // matrix multiplication
-        int threads = thread::hardware_concurrency();
-        #pragma omp parallel for collapse(2) shared(a, b, c) num_threads(threads) schedule(static, my_row_count*size/threads)
-        for (int row = 0; row < my_row_count; row++)
-        for (int col = 0; col < size; col++)
-        for (int i = 0; i < size; i++)
-            c[row][col] += a[row][i] * b[i][col];
+        if (crossover > 0) strassen_rows(a, b, c, 0, my_row_count, crossover);
+        else multiply_tiles(a, b, c, part, threads);
 
         // gather (receive) c
-        MPI_Gatherv(MPI_IN_PLACE, send_counts[rank], MPI_INT, c[0], send_counts, displacements, MPI_INT, 0, MPI_COMM_WORLD);
-        MPI_Barrier(MPI_COMM_WORLD);
+        double t_computed = MPI_Wtime();
+        MPI_Gatherv(MPI_IN_PLACE, send_counts[rank], MPI_ELEM, c.data(), send_counts, displacements, MPI_ELEM, 0, MPI_COMM_WORLD);
+        double phases[3] = {t_bcast - t_phase, t_computed - t_bcast, MPI_Wtime() - t_computed};
 
         // stop timing
         high_resolution_clock::time_point t_stop = high_resolution_clock::now();
@@ -120,68 +419,72 @@ int main(int argc, char **argv) {
         // calculate execution time
         duration<double> exec_time = duration_cast<duration<double>>(t_stop - t_start);
 
+        // slowest rank per phase
+        double slowest[3];
+        MPI_Reduce(phases, slowest, 3, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+
         // open file for output
         ofstream fh;
         fh.open("mm-mpi-omp_result.txt");
 
-        // print matrix a
-        fh << "Matrix A:" << endl;
-        for (int row = 0; row < size; row++) 
-        for (int col = 0; col < size; col++)
-            fh << a[row][col] << (col < size - 1 ? "," : "\n");
-
-        // print matrix b
-        fh << "Matrix B:" << endl;
-        for (int row = 0; row < size; row++) 
-        for (int col = 0; col < size; col++)
-            fh << b[row][col] << (col < size - 1 ? "," : "\n");
-
-        // print matrix c
-        fh << "Product:" << endl;
-        for (int row = 0; row < size; row++) 
-        for (int col = 0; col < size; col++)
-            fh << c[row][col] << (col < size - 1 ? "," : "\n");
+        // write matrices a, b and c as binary records, tools/mm-convert turns them back into csv.
+        // all of a is regenerated from the seed for the file, outside the timed region
+        int mh = open_matrix_file("mm-mpi-omp_result.mat");
+        bool written = mh >= 0;
+        if (written && dump_inputs) {
+            written = write_matrix(mh, new_rand_matrix(size, size, seed, MATRIX_STREAM_A, 0), "Matrix A") &&
+                      write_matrix(mh, b, "Matrix B");
+        }
+        if (written) written = write_matrix(mh, c, "Product");
+        if (!written) perror("mm-mpi-omp_result.mat");
+        if (mh >= 0) close(mh);
 
         // print stats
         fh << "Input Size:\t" << size << "\nElapsed Time:\t" << exec_time.count() << endl;
         cout << "Input Size:\t" << size << "\nElapsed Time:\t" << exec_time.count() << endl;
+        fh << "Broadcast Time:\t" << slowest[0] << "\nCompute Time:\t" << slowest[1] << "\nGather Time:\t" << slowest[2] << endl;
+        cout << "Broadcast Time:\t" << slowest[0] << "\nCompute Time:\t" << slowest[1] << "\nGather Time:\t" << slowest[2] << endl;
+        fh << "Threads:\t" << threads << (pin ? " pinned" : " unpinned") << endl;
+        cout << "Threads:\t" << threads << (pin ? " pinned" : " unpinned") << endl;
+        fh << "Seed:\t" << seed << endl;
+        cout << "Seed:\t" << seed << endl;
+
+        // same checksum as mm-mpi and the other modes report, so runs can be compared
+        char checksum_hex[17];
+        snprintf(checksum_hex, sizeof(checksum_hex), "%016llx", (unsigned long long)matrix_sum_checksum(c, 0));
+        fh << "Product Checksum:\t" << checksum_hex << endl;
+        cout << "Product Checksum:\t" << checksum_hex << endl;
+        if (crossover > 0) {
+            fh << "Strassen Crossover:\t" << crossover << endl;
+            cout << "Strassen Crossover:\t" << crossover << endl;
+        }
 
         fh.close();
-
-        free_matrix(a);
-        free_matrix(b);
-        free_matrix(c);
     }
     else {
-        // init matrices
-        a = new_matrix(my_row_count, size);
-        b = new_matrix(size, size);
-        c = new_zero_matrix(my_row_count, size);
-
-        // broadcast (receive) b
-        MPI_Bcast(b[0], size*size, MPI_INT, 0, MPI_COMM_WORLD);
-        MPI_Barrier(MPI_COMM_WORLD);
+        // init matrices, this rank's rows of a are generated locally instead of scattered.
+        // b is first touched in the compute tiles and then overwritten by the broadcast
+        a = new_rand_tiles(my_row_count, size, seed, MATRIX_STREAM_A, my_first_row, 0, part, threads);
+        b = new_zero_matrix(size, size, gemm_partition_resize(part, size, size), threads);
+        c = new_zero_matrix(my_row_count, size, part, threads);
 
-        // scatter (receive) a
-        MPI_Scatterv(a[0], send_counts, displacements, MPI_INT, a[0], send_counts[rank], MPI_INT, 0, MPI_COMM_WORLD);
-        MPI_Barrier(MPI_COMM_WORLD);
+        // broadcast (receive) b, the collectives synchronise so no barriers are needed between phases
+        double t_phase = MPI_Wtime();
+        MPI_Bcast(b.data(), size*size, MPI_ELEM, 0, MPI_COMM_WORLD);
+        double t_bcast = MPI_Wtime();
 
         // matrix multiplication
-        int threads = thread::hardware_concurrency();
-        #pragma omp parallel for collapse(2) shared(a, b, c) num_threads(threads) schedule(static, my_row_count*size/threads)
-        for (int row = 0; row < my_row_count; row++)
-        for (int col = 0; col < size; col++)
-        for (int i = 0; i < size; i++)
-            c[row][col] += a[row][i] * b[i][col];
+        if (crossover > 0) strassen_rows(a, b, c, 0, my_row_count, crossover);
+        else multiply_tiles(a, b, c, part, threads);
 
         // gather (send) c
-        MPI_Gatherv(c[0], send_counts[rank], MPI_INT, c[0], send_counts, displacements, MPI_INT, 0, MPI_COMM_WORLD);
-        MPI_Barrier(MPI_COMM_WORLD);
+        double t_computed = MPI_Wtime();
+        MPI_Gatherv(c.data(), send_counts[rank], MPI_ELEM, c.data(), send_counts, displacements, MPI_ELEM, 0, MPI_COMM_WORLD);
+        double phases[3] = {t_bcast - t_phase, t_computed - t_bcast, MPI_Wtime() - t_computed};
 
-        // clean up memory
-        free_matrix(a);
-        free_matrix(b);
-        free_matrix(c);
+        // slowest rank per phase
+        double slowest[3];
+        MPI_Reduce(phases, slowest, 3, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
     }
 
     MPI_Finalize();
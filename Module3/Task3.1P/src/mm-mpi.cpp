@@ -1,57 +1,276 @@
 #include <iostream>
 #include <fstream>
 #include <chrono>
+#include <string.h>
 #include <mpi.h>
+#include "../../../common/matrix.h"
+#include "../../../common/matrix_mpi.h"
+#include "../../../common/matrix_io.h"
+#include "../../../common/matrix_rand.h"
+#include "../../../common/gemm.h"
+#include "../../../common/strassen.h"
+#include "../../../common/summa.h"
+#include "../../../common/row_pipeline.h"
 
 using namespace std;
 using namespace chrono;
 
 #define MAX_ELEMENT 20
 
-int** new_matrix(int rows, int cols) {
+Matrix<elem_t> new_rand_matrix(int rows, int cols, uint64_t seed, uint32_t stream, int first_row) {
 
-    int** matrix = new int*[rows];
-    matrix[0] = new int[rows * cols];
-    for (int r = 1; r < rows; r++)
-        matrix[r] = &matrix[0][r*cols];
+    // rows [first_row, first_row + rows) of the counter-based matrix for this
+    // stream, identical whichever rank or thread generates them
+    Matrix<elem_t> matrix(rows, cols);
+    matrix_rand_fill(matrix, seed, stream, first_row, MAX_ELEMENT);
 
     return matrix;
 }
 
-int** new_rand_matrix(int rows, int cols) {
+Matrix<elem_t> new_zero_matrix(int rows, int cols) {
 
-    int** matrix = new_matrix(rows, cols);
-    for (int r = 0; r < rows; r++)
-    for (int c = 0; c < cols; c++)
-        matrix[r][c] = rand() % MAX_ELEMENT;
+    Matrix<elem_t> matrix(rows, cols);
+    matrix.fill(0);
 
     return matrix;
 }
 
-int** new_zero_matrix(int rows, int cols) {
+void multiply_rows(const Matrix<elem_t> &a, const Matrix<elem_t> &b, Matrix<elem_t> &c, int rows, int size, int crossover) {
 
-    int** matrix = new_matrix(rows, cols);
-    for (int r = 0; r < rows; r++)
-    for (int c = 0; c < cols; c++)
-        matrix[r][c] = 0;
+    if (crossover > 0)
+        strassen_rows(a, b, c, 0, rows, crossover);
+    else
+        gemm_tile(a, b, c, 0, rows, 0, size);
+}
 
-    return matrix;
+// write a gathered product to the output file. the inputs are regenerated
+// from the seed, outside the timed region, when they are written too.
+void write_product(int size, uint64_t seed, bool dump_inputs, const Matrix<elem_t> &product) {
+
+    int mh = open_matrix_file("mm-mpi_result.mat");
+    bool written = mh >= 0;
+    if (written && dump_inputs) {
+        written = write_matrix(mh, new_rand_matrix(size, size, seed, MATRIX_STREAM_A, 0), "Matrix A") &&
+                  write_matrix(mh, new_rand_matrix(size, size, seed, MATRIX_STREAM_B, 0), "Matrix B");
+    }
+    if (written) written = write_matrix(mh, product, "Product");
+    if (!written) perror("mm-mpi_result.mat");
+    if (mh >= 0) close(mh);
+}
+
+// every rank generates its own rows of a and all of b from the shared seed, so
+// no input is communicated. only the checksum of c is reduced, plus c itself
+// when gather_c is set, which separates compute scaling from distribution cost.
+void run_local(int size, int rank, uint64_t seed, int crossover, bool gather_c, bool dump_inputs,
+               int* send_counts, int* displacements) {
+
+    int my_row_count = send_counts[rank] / size;
+    int my_first_row = displacements[rank] / size;
+
+    // start every rank together so the phase times line up
+    MPI_Barrier(MPI_COMM_WORLD);
+    double t_start = MPI_Wtime();
+
+    Matrix<elem_t> a = new_rand_matrix(my_row_count, size, seed, MATRIX_STREAM_A, my_first_row);
+    Matrix<elem_t> b = new_rand_matrix(size, size, seed, MATRIX_STREAM_B, 0);
+    Matrix<elem_t> c = new_zero_matrix(my_row_count, size);
+    double t_generated = MPI_Wtime();
+
+    multiply_rows(a, b, c, my_row_count, size, crossover);
+    double t_computed = MPI_Wtime();
+
+    // partial checksums sum to the checksum of the whole product
+    uint64_t my_checksum = matrix_sum_checksum(c, my_first_row);
+    uint64_t checksum = 0;
+    MPI_Reduce(&my_checksum, &checksum, 1, MPI_UINT64_T, MPI_SUM, 0, MPI_COMM_WORLD);
+
+    Matrix<elem_t> product;
+    if (gather_c) {
+        if (rank == 0) product = Matrix<elem_t>(size, size);
+        MPI_Gatherv(c.data(), send_counts[rank], MPI_ELEM, product.data(), send_counts, displacements, MPI_ELEM, 0, MPI_COMM_WORLD);
+    }
+    double t_stop = MPI_Wtime();
+
+    // slowest rank per phase
+    double phases[4] = {t_stop - t_start, t_generated - t_start, t_computed - t_generated, t_stop - t_computed};
+    double slowest[4];
+    MPI_Reduce(phases, slowest, 4, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+
+    if (rank != 0) return;
+
+    if (gather_c) write_product(size, seed, dump_inputs, product);
+
+    ofstream fh;
+    fh.open("mm-mpi_result.txt");
+
+    char checksum_hex[17];
+    snprintf(checksum_hex, sizeof(checksum_hex), "%016llx", (unsigned long long)checksum);
+
+    for (ostream* out : {(ostream*)&fh, (ostream*)&cout}) {
+        *out << "Input Size:\t" << size << "\nElapsed Time:\t" << slowest[0] << endl;
+        *out << "Generate Time:\t" << slowest[1] << "\nCompute Time:\t" << slowest[2] << endl;
+        *out << (gather_c ? "Gather Time:\t" : "Reduce Time:\t") << slowest[3] << endl;
+        *out << "Product Checksum:\t" << checksum_hex << endl;
+        *out << "Seed:\t" << seed << endl;
+        if (crossover > 0) *out << "Strassen Crossover:\t" << crossover << endl;
+    }
+
+    fh.close();
+}
+
+// 2d summa: every rank generates and keeps only its blocks of a, b and c, and
+// panels of a and b are broadcast along grid rows and columns. only the
+// checksum of c is reduced, plus c itself when gather_c is set.
+void run_summa(int size, uint64_t seed, int panel, bool gather_c, bool dump_inputs) {
+
+    summa_grid grid = summa_grid_create(MPI_COMM_WORLD);
+    int rank;
+    MPI_Comm_rank(grid.comm, &rank);
+
+    // square problem, so the blocks of a, b and c all have the same shape
+    int my_rows = summa_block_size(size, grid.rows, grid.row);
+    int my_cols = summa_block_size(size, grid.cols, grid.col);
+    int first_row = summa_block_start(size, grid.rows, grid.row);
+    int first_col = summa_block_start(size, grid.cols, grid.col);
+
+    MPI_Barrier(grid.comm);
+    double t_start = MPI_Wtime();
+
+    Matrix<elem_t> a(my_rows, my_cols), b(my_rows, my_cols);
+    matrix_rand_block(a, seed, MATRIX_STREAM_A, first_row, first_col, MAX_ELEMENT);
+    matrix_rand_block(b, seed, MATRIX_STREAM_B, first_row, first_col, MAX_ELEMENT);
+    Matrix<elem_t> c = new_zero_matrix(my_rows, my_cols);
+    double t_generated = MPI_Wtime();
+
+    summa_times times;
+    summa(grid, size, size, size, a, b, c, panel, summa_gemm_kernel<elem_t>, NULL, &times);
+    double t_computed = MPI_Wtime();
+
+    uint64_t my_checksum = matrix_block_checksum(c, first_row, first_col, size);
+    uint64_t checksum = 0;
+    MPI_Reduce(&my_checksum, &checksum, 1, MPI_UINT64_T, MPI_SUM, 0, grid.comm);
+
+    Matrix<elem_t> product;
+    if (gather_c) summa_gather(grid, size, size, c, product);
+    double t_stop = MPI_Wtime();
+
+    // slowest rank per phase
+    double phases[6] = {t_stop - t_start, t_generated - t_start, t_computed - t_generated,
+                        times.compute, times.wait, t_stop - t_computed};
+    double slowest[6];
+    MPI_Reduce(phases, slowest, 6, MPI_DOUBLE, MPI_MAX, 0, grid.comm);
+
+    if (rank == 0) {
+        if (gather_c) write_product(size, seed, dump_inputs, product);
+
+        ofstream fh;
+        fh.open("mm-mpi_result.txt");
+
+        char checksum_hex[17];
+        snprintf(checksum_hex, sizeof(checksum_hex), "%016llx", (unsigned long long)checksum);
+
+        for (ostream* out : {(ostream*)&fh, (ostream*)&cout}) {
+            *out << "Input Size:\t" << size << "\nElapsed Time:\t" << slowest[0] << endl;
+            *out << "Grid:\t" << grid.rows << " x " << grid.cols << "\nPanel:\t" << panel << endl;
+            *out << "Generate Time:\t" << slowest[1] << "\nSUMMA Time:\t" << slowest[2] << endl;
+            *out << "  Compute Time:\t" << slowest[3] << "\n  Broadcast Wait:\t" << slowest[4] << endl;
+            *out << (gather_c ? "Gather Time:\t" : "Reduce Time:\t") << slowest[5] << endl;
+            *out << "Product Checksum:\t" << checksum_hex << endl;
+            *out << "Seed:\t" << seed << endl;
+        }
+
+        fh.close();
+    }
+
+    summa_grid_free(&grid);
 }
 
-void free_matrix(int** matrix) {
-    delete matrix[0];
-    delete matrix;
+// rank 0 streams a to the other ranks in chunks of rows, each chunk is
+// multiplied as soon as it arrives and its rows of c are sent straight back
+void run_pipeline(int size, int rank, uint64_t seed, int chunk, bool dump_inputs) {
+
+    Matrix<elem_t> a, b, c;
+    if (rank == 0) {
+        a = new_rand_matrix(size, size, seed, MATRIX_STREAM_A, 0);
+        b = new_rand_matrix(size, size, seed, MATRIX_STREAM_B, 0);
+        c = Matrix<elem_t>(size, size);
+    }
+
+    MPI_Barrier(MPI_COMM_WORLD);
+    double t_start = MPI_Wtime();
+
+    pipeline_times times;
+    pipeline_multiply(MPI_COMM_WORLD, size, chunk, a, b, c, summa_gemm_kernel<elem_t>, NULL, &times);
+    double t_stop = MPI_Wtime();
+
+    // slowest rank per phase
+    double phases[5] = {t_stop - t_start, times.bcast, times.a_wait, times.compute, times.c_wait};
+    double slowest[5];
+    MPI_Reduce(phases, slowest, 5, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+
+    if (rank != 0) return;
+
+    int mh = open_matrix_file("mm-mpi_result.mat");
+    bool written = mh >= 0;
+    if (written && dump_inputs) written = write_matrix(mh, a, "Matrix A") && write_matrix(mh, b, "Matrix B");
+    if (written) written = write_matrix(mh, c, "Product");
+    if (!written) perror("mm-mpi_result.mat");
+    if (mh >= 0) close(mh);
+
+    ofstream fh;
+    fh.open("mm-mpi_result.txt");
+
+    char checksum_hex[17];
+    snprintf(checksum_hex, sizeof(checksum_hex), "%016llx", (unsigned long long)matrix_sum_checksum(c, 0));
+
+    // communication that was not hidden behind the slowest rank's compute
+    double exposed = slowest[0] - slowest[3];
+
+    for (ostream* out : {(ostream*)&fh, (ostream*)&cout}) {
+        *out << "Input Size:\t" << size << "\nElapsed Time:\t" << slowest[0] << endl;
+        *out << "Chunk Rows:\t" << chunk << endl;
+        *out << "Broadcast Time:\t" << slowest[1] << "\nA Wait Time:\t" << slowest[2] << endl;
+        *out << "Compute Time:\t" << slowest[3] << "\nC Wait Time:\t" << slowest[4] << endl;
+        *out << "Exposed Communication:\t" << (exposed > 0 ? exposed : 0) << endl;
+        *out << "Product Checksum:\t" << checksum_hex << endl;
+        *out << "Seed:\t" << seed << endl;
+    }
+
+    fh.close();
 }
 
 int main(int argc, char **argv) {
     
     MPI_Init(&argc, &argv);
     
-    //srand(time(NULL));
-
-    // get matrix size (rows, cols)
+    // get matrix size (rows, cols), --strassen or --crossover N selects strassen-winograd,
+    // --no-inputs writes only the product, --seed N reproduces the inputs of an earlier run,
+    // --local generates inputs on every rank and reduces only a checksum of c (--gather also collects c),
+    // --summa does the same on a 2d grid with blocks of a and b broadcast in panels of --panel N,
+    // --pipeline streams a out and c back in chunks of --chunk N rows, overlapping both with compute
     int size = 5;
-    if (argc > 1) size = atoi(argv[1]);
+    int crossover = 0;
+    bool dump_inputs = true;
+    bool local = false;
+    bool gather_c = false;
+    bool use_summa = false;
+    int panel = SUMMA_PANEL;
+    bool pipeline = false;
+    int chunk = PIPELINE_CHUNK;
+    uint64_t seed = matrix_rand_seed();
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--no-inputs") == 0) dump_inputs = false;
+        else if (strcmp(argv[i], "--local") == 0) local = true;
+        else if (strcmp(argv[i], "--gather") == 0) gather_c = true;
+        else if (strcmp(argv[i], "--summa") == 0) use_summa = true;
+        else if (strcmp(argv[i], "--panel") == 0 && i + 1 < argc) panel = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--pipeline") == 0) pipeline = true;
+        else if (strcmp(argv[i], "--chunk") == 0 && i + 1 < argc) chunk = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) seed = strtoull(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "--strassen") == 0 && crossover == 0) crossover = STRASSEN_CROSSOVER;
+        else if (strcmp(argv[i], "--crossover") == 0 && i + 1 < argc) crossover = atoi(argv[++i]);
+        else size = atoi(argv[i]);
+    }
 
     // get number of processes
     int np;
@@ -61,6 +280,21 @@ int main(int argc, char **argv) {
     int rank;
     MPI_Comm_rank(MPI_COMM_WORLD, &rank);
 
+    // every rank generates from rank 0's seed
+    MPI_Bcast(&seed, 1, MPI_UINT64_T, 0, MPI_COMM_WORLD);
+
+    if (pipeline) {
+        run_pipeline(size, rank, seed, chunk > 0 ? chunk : PIPELINE_CHUNK, dump_inputs);
+        MPI_Finalize();
+        return 0;
+    }
+
+    if (use_summa) {
+        run_summa(size, seed, panel > 0 ? panel : SUMMA_PANEL, gather_c, dump_inputs);
+        MPI_Finalize();
+        return 0;
+    }
+
     // calculate send counts and displacements
     int send_counts[np] = {0};
     int displacements[np] = {0};
@@ -75,40 +309,42 @@ int main(int argc, char **argv) {
             send_counts[i] += size;
             rows_remainder--;
         }
-        if (i < size - 1)
+        if (i < np - 1)
             displacements[i + 1] = displacements[i] + send_counts[i];
     }    
 
+    if (local) {
+        run_local(size, rank, seed, crossover, gather_c, dump_inputs, send_counts, displacements);
+        MPI_Finalize();
+        return 0;
+    }
+
     // define vars for matrix multiplication
-    int **a, **b, **c;
+    Matrix<elem_t> a, b, c;
     int my_row_count = send_counts[rank] / size;
+    int my_first_row = displacements[rank] / size;
 
     if (rank == 0) {
-        // init matrices
-        a = new_rand_matrix(size, size);
-        b = new_rand_matrix(size, size);
+        // init matrices, all of a is only needed when it is written to the output file
+        a = new_rand_matrix(dump_inputs ? size : my_row_count, size, seed, MATRIX_STREAM_A, 0);
+        b = new_rand_matrix(size, size, seed, MATRIX_STREAM_B, 0);
         c = new_zero_matrix(size, size);
 
         // start timing
         high_resolution_clock::time_point t_start = high_resolution_clock::now();
 
-        // broadcast (send) b
-        MPI_Bcast(b[0], size*size, MPI_INT, 0, MPI_COMM_WORLD);
-        MPI_Barrier(MPI_COMM_WORLD);
-
-        // scatter (send) a
-        MPI_Scatterv(a[0], send_counts, displacements, MPI_INT, MPI_IN_PLACE, send_counts[rank], MPI_INT, 0, MPI_COMM_WORLD);
-        MPI_Barrier(MPI_COMM_WORLD);
+        // broadcast (send) b, the collectives synchronise so no barriers are needed between phases
+        double t_phase = MPI_Wtime();
+        MPI_Bcast(b.data(), size*size, MPI_ELEM, 0, MPI_COMM_WORLD);
+        double t_bcast = MPI_Wtime();
 
         // matrix multiplication
-        for (int row = 0; row < my_row_count; row++)
-        for (int col = 0; col < size; col++)
-        for (int i = 0; i < size; i++)
-            c[row][col] += a[row][i] * b[i][col];
+        multiply_rows(a, b, c, my_row_count, size, crossover);
 
         // gather (receive) c
-        MPI_Gatherv(MPI_IN_PLACE, send_counts[rank], MPI_INT, c[0], send_counts, displacements, MPI_INT, 0, MPI_COMM_WORLD);
-        MPI_Barrier(MPI_COMM_WORLD);
+        double t_computed = MPI_Wtime();
+        MPI_Gatherv(MPI_IN_PLACE, send_counts[rank], MPI_ELEM, c.data(), send_counts, displacements, MPI_ELEM, 0, MPI_COMM_WORLD);
+        double phases[3] = {t_bcast - t_phase, t_computed - t_bcast, MPI_Wtime() - t_computed};
 
         // stop timing
         high_resolution_clock::time_point t_stop = high_resolution_clock::now();
@@ -116,66 +352,64 @@ int main(int argc, char **argv) {
         // calculate execution time
         duration<double> exec_time = duration_cast<duration<double>>(t_stop - t_start);
 
+        // slowest rank per phase
+        double slowest[3];
+        MPI_Reduce(phases, slowest, 3, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+
         // open file for output
         ofstream fh;
         fh.open("mm-mpi_result.txt");
 
-        // print matrix a
-        fh << "Matrix A:" << endl;
-        for (int row = 0; row < size; row++) 
-        for (int col = 0; col < size; col++)
-            fh << a[row][col] << (col < size - 1 ? "," : "\n");
-
-        // print matrix b
-        fh << "Matrix B:" << endl;
-        for (int row = 0; row < size; row++) 
-        for (int col = 0; col < size; col++)
-            fh << b[row][col] << (col < size - 1 ? "," : "\n");
-
-        // print matrix c
-        fh << "Product:" << endl;
-        for (int row = 0; row < size; row++) 
-        for (int col = 0; col < size; col++)
-            fh << c[row][col] << (col < size - 1 ? "," : "\n");
+        // write matrices a, b and c as binary records, tools/mm-convert turns them back into csv
+        int mh = open_matrix_file("mm-mpi_result.mat");
+        bool written = mh >= 0;
+        if (written && dump_inputs) written = write_matrix(mh, a, "Matrix A") && write_matrix(mh, b, "Matrix B");
+        if (written) written = write_matrix(mh, c, "Product");
+        if (!written) perror("mm-mpi_result.mat");
+        if (mh >= 0) close(mh);
 
         // print stats
         fh << "Input Size:\t" << size << "\nElapsed Time:\t" << exec_time.count() << endl;
         cout << "Input Size:\t" << size << "\nElapsed Time:\t" << exec_time.count() << endl;
+        fh << "Broadcast Time:\t" << slowest[0] << "\nCompute Time:\t" << slowest[1] << "\nGather Time:\t" << slowest[2] << endl;
+        cout << "Broadcast Time:\t" << slowest[0] << "\nCompute Time:\t" << slowest[1] << "\nGather Time:\t" << slowest[2] << endl;
+        fh << "Seed:\t" << seed << endl;
+        cout << "Seed:\t" << seed << endl;
+
+        // same checksum as --local reports, so the two modes can be compared
+        char checksum_hex[17];
+        snprintf(checksum_hex, sizeof(checksum_hex), "%016llx", (unsigned long long)matrix_sum_checksum(c, 0));
+        fh << "Product Checksum:\t" << checksum_hex << endl;
+        cout << "Product Checksum:\t" << checksum_hex << endl;
+        if (crossover > 0) {
+            fh << "Strassen Crossover:\t" << crossover << endl;
+            cout << "Strassen Crossover:\t" << crossover << endl;
+        }
 
         fh.close();
-
-        free_matrix(a);
-        free_matrix(b);
-        free_matrix(c);
     }
     else {
-        // init matrices
-        a = new_matrix(my_row_count, size);
-        b = new_matrix(size, size);
+        // init matrices, this rank's rows of a are generated locally instead of scattered
+        a = new_rand_matrix(my_row_count, size, seed, MATRIX_STREAM_A, my_first_row);
+        b = Matrix<elem_t>(size, size);
         c = new_zero_matrix(my_row_count, size);
 
-        // broadcast (receive) b
-        MPI_Bcast(b[0], size*size, MPI_INT, 0, MPI_COMM_WORLD);
-        MPI_Barrier(MPI_COMM_WORLD);
-
-        // scatter (receive) a
-        MPI_Scatterv(a[0], send_counts, displacements, MPI_INT, a[0], send_counts[rank], MPI_INT, 0, MPI_COMM_WORLD);
-        MPI_Barrier(MPI_COMM_WORLD);
+        // broadcast (receive) b, the collectives synchronise so no barriers are needed between phases
+        double t_phase = MPI_Wtime();
+        MPI_Bcast(b.data(), size*size, MPI_ELEM, 0, MPI_COMM_WORLD);
+        double t_bcast = MPI_Wtime();
 
         // matrix multiplication
-        for (int row = 0; row < my_row_count; row++)
-        for (int col = 0; col < size; col++)
-        for (int i = 0; i < size; i++)
-            c[row][col] += a[row][i] * b[i][col];
+        multiply_rows(a, b, c, my_row_count, size, crossover);
 
         // gather (send) c
-        MPI_Gatherv(c[0], send_counts[rank], MPI_INT, c[0], send_counts, displacements, MPI_INT, 0, MPI_COMM_WORLD);
-        MPI_Barrier(MPI_COMM_WORLD);
+        double t_computed = MPI_Wtime();
+        MPI_Gatherv(c.data(), send_counts[rank], MPI_ELEM, c.data(), send_counts, displacements, MPI_ELEM, 0, MPI_COMM_WORLD);
+        double phases[3] = {t_bcast - t_phase, t_computed - t_bcast, MPI_Wtime() - t_computed};
 
-        // clean up memory
-        free_matrix(a);
-        free_matrix(b);
-        free_matrix(c);
+        // slowest rank per phase
+        double slowest[3];
+        MPI_Reduce(phases, slowest, 3, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
     }
 
     MPI_Finalize();
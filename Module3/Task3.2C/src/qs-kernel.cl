@@ -1,30 +1,100 @@
-__kernel
-void quicksort(queue_t queue, __global int* arr, int low, int high)
-{   
-    if (low < high)
-    {
-        int pivot = arr[high];
-        int i = (low - 1);
-        for (int j = low; j <= high - 1; j++)
-        {
-            if (arr[j] <= pivot)
-            {
-                i++;
-                int tmp = arr[i];
-                arr[i] = arr[j];
-                arr[j] = tmp;
-            }
-        }
-
-        int tmp = arr[i + 1];
-        arr[i + 1] = arr[high];
-        arr[high] = tmp;
-
-        int pi = i + 1;
-
-        const ndrange_t ndrange = ndrange_1D(1);
-        kernel_enqueue_flags_t flags = CLK_ENQUEUE_FLAGS_NO_WAIT;
-        enqueue_kernel(queue, flags, ndrange, ^{ quicksort(queue, arr, low, pi - 1); });
-        enqueue_kernel(queue, flags, ndrange, ^{ quicksort(queue, arr, pi + 1, high); });
+// Data-parallel sort kernels for 32-bit int keys, OpenCL 1.2.
+//
+// LSD radix sort, RADIX_BITS per pass: the keys are split into one contiguous
+// chunk per work-item. radix_histogram counts each chunk's digits,
+// radix_scan turns the counts into exclusive offsets (laid out digit-major, so
+// one scan orders every chunk's keys for digit d after all keys of digit
+// d - 1 and after earlier chunks' keys of digit d), and radix_scatter moves
+// each chunk's keys to their offsets in order, which keeps the sort stable.
+// the sign bit is flipped when extracting digits so negative keys sort first.
+//
+// bitonic_step is the fallback: one compare-exchange step of a bitonic
+// network over a power-of-two buffer padded with INT_MAX.
+
+#define RADIX_BITS 8
+#define RADIX_BINS (1 << RADIX_BITS)
+
+inline uint radix_digit(int key, int shift) {
+    return (((uint)key ^ 0x80000000u) >> shift) & (RADIX_BINS - 1);
+}
+
+// counts[d * chunks + c] = keys of chunk c with digit d
+__kernel void radix_histogram(const __global int* keys, const int n, const int chunk, const int shift,
+                              __global uint* counts) {
+
+    const int c = get_global_id(0);
+    const int chunks = get_global_size(0);
+    const int first = c * chunk;
+    const int last = min(first + chunk, n);
+
+    uint hist[RADIX_BINS];
+    for (int d = 0; d < RADIX_BINS; d++) hist[d] = 0;
+
+    for (int i = first; i < last; i++) hist[radix_digit(keys[i], shift)]++;
+
+    for (int d = 0; d < RADIX_BINS; d++) counts[d * chunks + c] = hist[d];
+}
+
+// exclusive prefix sum of counts[0, m) in place, run as a single work-group.
+// each work-item sums a contiguous segment, the segment totals are scanned in
+// local memory, then each work-item rewrites its segment from its offset.
+__kernel void radix_scan(__global uint* counts, const int m, __local uint* totals) {
+
+    const int id = get_local_id(0);
+    const int items = get_local_size(0);
+    const int segment = (m + items - 1) / items;
+    const int first = min(id * segment, m);
+    const int last = min(first + segment, m);
+
+    uint sum = 0;
+    for (int i = first; i < last; i++) sum += counts[i];
+    totals[id] = sum;
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    // inclusive hillis-steele scan of the segment totals
+    for (int offset = 1; offset < items; offset <<= 1) {
+        uint add = id >= offset ? totals[id - offset] : 0;
+        barrier(CLK_LOCAL_MEM_FENCE);
+        totals[id] += add;
+        barrier(CLK_LOCAL_MEM_FENCE);
+    }
+
+    uint running = id > 0 ? totals[id - 1] : 0;
+    for (int i = first; i < last; i++) {
+        uint count = counts[i];
+        counts[i] = running;
+        running += count;
+    }
+}
+
+__kernel void radix_scatter(const __global int* keys, __global int* sorted, const int n, const int chunk,
+                            const int shift, const __global uint* offsets) {
+
+    const int c = get_global_id(0);
+    const int chunks = get_global_size(0);
+    const int first = c * chunk;
+    const int last = min(first + chunk, n);
+
+    uint next[RADIX_BINS];
+    for (int d = 0; d < RADIX_BINS; d++) next[d] = offsets[d * chunks + c];
+
+    for (int i = first; i < last; i++) {
+        int key = keys[i];
+        sorted[next[radix_digit(key, shift)]++] = key;
+    }
+}
+
+// compare-exchange elements i and i ^ j, ascending where bit k of i is clear
+__kernel void bitonic_step(__global int* keys, const int j, const int k) {
+
+    const int i = get_global_id(0);
+    const int l = i ^ j;
+    if (l <= i) return;
+
+    int a = keys[i], b = keys[l];
+    bool ascending = (i & k) == 0;
+    if ((a > b) == ascending) {
+        keys[i] = b;
+        keys[l] = a;
     }
-}
\ No newline at end of file
+}
@@ -1,23 +1,39 @@
 #include <iostream>
 #include <stdlib.h>
+#include <string.h>
 #include <chrono>
 #include <mpi.h>
-#include <CL/cl.h>
+#include "../../../common/cl_sort.h"
+#include "../../../common/sample_sort.h"
 
 using namespace std;
 using namespace chrono;
 
+// device sort engine, CL_SORT_RADIX or CL_SORT_BITONIC
+int engine = CL_SORT_RADIX;
+
+// device time of this rank's sort
+cl_sort_times sort_times;
+
 // forward declarations
 void quickSort(int*, int, int);
-cl_device_id create_cl_device();
-cl_program create_cl_program(cl_context, cl_device_id, const char*);
 
 int main(int argc, char** argv) {
 
     MPI_Init(&argc, &argv);
 
+    // element count, --gather collects the sorted array on rank 0 and checks it there too,
+    // --root-merge gathers every rank's sorted block on rank 0 and k-way merges them there,
+    // --bitonic sorts with the bitonic network instead of the radix sort
     int el_count = 10;
-    if (argc > 1) el_count = atoi(argv[1]);
+    bool gather = false;
+    bool root_merge = false;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--gather") == 0) gather = true;
+        else if (strcmp(argv[i], "--root-merge") == 0) root_merge = true;
+        else if (strcmp(argv[i], "--bitonic") == 0) engine = CL_SORT_BITONIC;
+        else el_count = atoi(argv[i]);
+    }
 
     int max_el = el_count * 10;
 
@@ -29,237 +45,123 @@ int main(int argc, char** argv) {
     int rank;
     MPI_Comm_rank(MPI_COMM_WORLD, &rank);
 
-    // enforce 2 nodes
-    if (np != 2)
-    {
-        if (rank == 0)
-            perror("Error: Number of MPI nodes must be 2. Exiting... ");
-        
-        exit(1);
+    // calculate send counts and displacements, any number of ranks
+    int* send_counts = (int*)malloc(np * sizeof(int));
+    int* displacements = (int*)malloc(np * sizeof(int));
+    for (int r = 0, offset = 0; r < np; r++) {
+        send_counts[r] = el_count / np + (r < el_count % np ? 1 : 0);
+        displacements[r] = offset;
+        offset += send_counts[r];
     }
 
-    // calculate send counts and displacements
-    int elems_per_process = el_count / 2;
-    
-    int send_counts[2] = {elems_per_process, elems_per_process};
-    if (el_count % 2 == 1) send_counts[0] += 1;
-
-    int displacements[2] = {0, send_counts[0]};
-
-    int *data;
     int my_el_count = send_counts[rank];
+    int* data;
+    uint64_t input_hash = 0;
 
     if (rank == 0) {
-        
-        // generate random array
-        int* data = (int*)malloc(el_count * sizeof(int));
+
+        // generate random array, with its order-independent hash for the permutation check
+        data = (int*)malloc(el_count * sizeof(int));
         for (int i = 0; i < el_count; i++) {
             data[i] = rand() % (max_el - 1) + 1;
+            input_hash += sort_key_hash(data[i]);
         }
+    }
+    else {
+        data = (int*)malloc((my_el_count > 0 ? my_el_count : 1) * sizeof(int));
+    }
 
-        // start timing
-        high_resolution_clock::time_point t_start = high_resolution_clock::now();
-
-        // scatter (send) data
-        MPI_Scatterv(data, send_counts, displacements, MPI_INT, MPI_IN_PLACE, send_counts[rank], MPI_INT, 0, MPI_COMM_WORLD);
-        MPI_Barrier(MPI_COMM_WORLD);
-
-        // quicksort my elements
-        quickSort(data, 0, my_el_count - 1);
-
-        // gather (receive) data
-        MPI_Gatherv(MPI_IN_PLACE, send_counts[rank], MPI_INT, data, send_counts, displacements, MPI_INT, 0, MPI_COMM_WORLD);
-        MPI_Barrier(MPI_COMM_WORLD);
-
-        // merge sorted data
-        int* sorted = (int*)malloc(el_count * sizeof(int));
-        int u1 = 0, u2 = displacements[1], s = 0;
-        while (u1 < displacements[1] && u2 < el_count)
-        {
-            if (data[u1] <= data[u2])
-                sorted[s++] = data[u1++];
-            else
-                sorted[s++] = data[u2++];
-        }
+    // bring up the device and build the kernels outside the timed region
+    cl_sort_build();
 
-        while (u1 < displacements[1])
-            sorted[s++] = data[u1++];
+    MPI_Barrier(MPI_COMM_WORLD);
 
-        while (u2 < el_count)
-            sorted[s++] = data[u2++];
+    // start timing
+    high_resolution_clock::time_point t_start = high_resolution_clock::now();
 
-        // stop timing
-        high_resolution_clock::time_point t_stop = high_resolution_clock::now();
+    // scatter data
+    MPI_Scatterv(data, send_counts, displacements, MPI_INT, rank == 0 ? MPI_IN_PLACE : data, my_el_count, MPI_INT, 0, MPI_COMM_WORLD);
 
-        // calculate execution time
-        duration<double> exec_time = duration_cast<duration<double>>(t_stop - t_start);
-        cout << "Sort completed in " << exec_time.count() << " seconds." << endl;
-
-        // Validity Test (10 Samples)
-        int span = el_count / 10;
-        bool fail = false;
-        printf("Validity Test (10 Samples): \n");
-        for (int i = 0; i < 10; i++) {
-            printf("%d ", sorted[i*span]);
-            if (i > 0) {
-                if (sorted[i*span] < sorted[(i-1)*span]) {
-                    printf("<-- FAIL");
-                    fail = true;
-                    break;
-                }
-            }
-        }
-        if (fail == false) {
-            printf(": PASS");
-        }
-        printf("\n");
-
-        // clean up data
-        free(sorted);
-        free(data);
-    }
+    // sample sort, every rank ends up with one sorted bucket of the whole array,
+    // or with --root-merge rank 0 ends up with all of it
+    int bucket_count;
+    sample_sort_times times;
+    int* bucket;
+    if (root_merge)
+        bucket = gather_merge_sort(data, send_counts, displacements, quickSort, MPI_COMM_WORLD, &bucket_count, &times);
     else
-    {
-        int* data = (int*)malloc(my_el_count * sizeof(int));
-
-        // scatter (receive) data
-        MPI_Scatterv(data, send_counts, displacements, MPI_INT, data, send_counts[rank], MPI_INT, 0, MPI_COMM_WORLD);
-        MPI_Barrier(MPI_COMM_WORLD);
+        bucket = sample_sort(data, my_el_count, quickSort, MPI_COMM_WORLD, &bucket_count, &times);
+    MPI_Barrier(MPI_COMM_WORLD);
 
-        // quicksort my elements
-        quickSort(data, 0, my_el_count - 1);
-
-        // gather (send) data
-        MPI_Gatherv(data, send_counts[rank], MPI_INT, data, send_counts, displacements, MPI_INT, 0, MPI_COMM_WORLD);
-        MPI_Barrier(MPI_COMM_WORLD);
-
-        // clean up memory
-        free(data);
-    }
-
-    MPI_Finalize();
-    return 0;
-}
+    // stop timing
+    high_resolution_clock::time_point t_stop = high_resolution_clock::now();
 
-void quickSort(int* data, int low, int high) {
+    // slowest rank per phase, and the bucket balance
+    double phases[3] = {times.local_sort, times.exchange, times.merge};
+    double max_phases[3];
+    MPI_Reduce(phases, max_phases, 3, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
 
-    cl_int              err;
-    cl_device_id        device;
-    cl_context          context;
-    cl_program          program;
-    cl_command_queue    queue;
-    cl_kernel           kernel;
-    cl_mem              buf;
-
-    // create device
-    device = create_cl_device();
-
-    // create context
-    context = clCreateContext(NULL, 1, &device, NULL, NULL, &err);
-    if (err < 0) {
-        perror("Failed to create context. Exiting...\n");
-        exit(1);
-    }
+    int min_bucket, max_bucket;
+    MPI_Reduce(&bucket_count, &min_bucket, 1, MPI_INT, MPI_MIN, 0, MPI_COMM_WORLD);
+    MPI_Reduce(&bucket_count, &max_bucket, 1, MPI_INT, MPI_MAX, 0, MPI_COMM_WORLD);
 
-    // create program from source file
-    program = create_cl_program(context, device, "qs-kernel.cl");
+    // check every key of the distributed result
+    high_resolution_clock::time_point v_start = high_resolution_clock::now();
+    bool valid = sample_sort_verify(bucket, bucket_count, el_count, input_hash, MPI_COMM_WORLD);
+    duration<double> verify_time = duration_cast<duration<double>>(high_resolution_clock::now() - v_start);
 
-    // create command queue
-    queue = clCreateCommandQueueWithProperties(context, device, 0, &err);
-    if (err < 0) {
-        perror("Failed to create command queue. Exiting...\n");
-        exit(1);
-    }
+    if (rank == 0) {
 
-    // create kernel
-    kernel = clCreateKernel(program, "quicksort", &err);
-    if (err < 0) {
-        perror("Failed to create kernel. Exiting...\n");
-        exit(1);
+        // calculate execution time
+        duration<double> exec_time = duration_cast<duration<double>>(t_stop - t_start);
+        cout << "Sort completed in " << exec_time.count() << " seconds." << endl;
+        cout << "Local Sort Time:\t" << max_phases[0] << endl;
+        cout << (root_merge ? "Gather Time:\t" : "Exchange Time:\t") << max_phases[1] << endl;
+        cout << "Merge Time:\t" << max_phases[2] << "\t(" << kway_merge_threads() << " threads)" << endl;
+        if (!root_merge)
+            cout << "Bucket Sizes:\t" << min_bucket << " - " << max_bucket << " (average " << el_count / np << ")" << endl;
+        cout << "Engine:\t" << cl_sort_engine_name(cl_sort_engine(engine, my_el_count)) << endl;
+        cout << "Rank 0 Kernel Time:\t" << sort_times.sort << " s\t(" << my_el_count / sort_times.sort << " keys/s)" << endl;
+        cout << "Rank 0 Transfer Time:\t" << sort_times.upload + sort_times.download << endl;
+        printf("Validity Test (%d elements, order and multiset hash): %s\n", el_count, valid ? "PASS" : "FAIL");
+        cout << "Verify Time:\t" << verify_time.count() << "\t(" << 100 * verify_time.count() / exec_time.count() << "% of sort)" << endl;
     }
 
-    buf = clCreateBuffer(context, CL_MEM_READ_ONLY,  (high + 1)*sizeof(int), NULL, NULL);
-    clEnqueueWriteBuffer(queue, buf, CL_TRUE, 0, (high + 1)*sizeof(int), data, 0, NULL, NULL);  
+    // optionally collect the buckets, in rank order they are the sorted array
+    if (gather) {
+        int* bucket_counts = (int*)malloc(np * sizeof(int));
+        int* bucket_displacements = (int*)malloc(np * sizeof(int));
+        MPI_Gather(&bucket_count, 1, MPI_INT, bucket_counts, 1, MPI_INT, 0, MPI_COMM_WORLD);
+        for (int r = 0, offset = 0; rank == 0 && r < np; r++) {
+            bucket_displacements[r] = offset;
+            offset += bucket_counts[r];
+        }
 
-    clSetKernelArg(kernel, 0, sizeof(cl_command_queue), (void*)&queue);
-    clSetKernelArg(kernel, 1, sizeof(cl_mem), (void*)&buf);
-    clSetKernelArg(kernel, 2, sizeof(int), (void*)&low);
-    clSetKernelArg(kernel, 3, sizeof(int), (void*)&high);
+        MPI_Gatherv(bucket, bucket_count, MPI_INT, data, bucket_counts, bucket_displacements, MPI_INT, 0, MPI_COMM_WORLD);
 
-    // execute quicksort
-    clEnqueueTask(queue, kernel, 0, NULL, NULL);
-    clEnqueueReadBuffer(queue, buf, CL_TRUE, 0, (high + 1)*sizeof(int), data, 0, NULL, NULL);
-}
+        if (rank == 0) {
+            bool sorted = sort_verify(data, el_count, input_hash, sort_verify_threads());
+            printf("Gathered Validity Test (%d elements): %s\n", el_count, sorted ? "PASS" : "FAIL");
+        }
 
-cl_device_id create_cl_device() {
-    
-    cl_int          err;
-    cl_platform_id  platform;
-    cl_device_id    device;
-
-    err = clGetPlatformIDs(1, &platform, NULL);
-    if (err < 0) {
-        perror("Failed to identify a platform. Exiting...\n");
-        exit(1);
+        free(bucket_displacements);
+        free(bucket_counts);
     }
 
-    err = clGetDeviceIDs(platform, CL_DEVICE_TYPE_GPU, 1, &device, NULL);
-    if (err < 0) {
-        perror("Failed to access GPU device. Attempting CPU...\n");
-        err = clGetDeviceIDs(platform, CL_DEVICE_TYPE_CPU, 1, &device, NULL);
-    }
-    if (err < 0) {
-        perror("Failed to access CPU device. No devices available. Exiting...\n");
-        exit(1);
-    }
+    // clean up memory
+    free(bucket);
+    free(data);
+    free(displacements);
+    free(send_counts);
 
-    return device;
+    cl_runtime_shutdown();
+    MPI_Finalize();
+    return 0;
 }
 
-cl_program create_cl_program(cl_context context, cl_device_id device, const char* filename) {
-    
-    FILE        *fp;
-    char        *program_buffer, *program_log;
-    size_t      program_size, log_size;
-    cl_int      err;
-    cl_program  program;
-
-    fp = fopen(filename, "r");
-    if (fp == NULL) {
-        perror("Failed to open program file. Exiting...\n");
-        exit(1);
-    }
-
-    fseek(fp, 0, SEEK_END);
-    program_size = ftell(fp);
-    rewind(fp);
-
-    program_buffer = (char*)malloc(program_size + 1);
-    program_buffer[program_size] = '\0';
-    fread(program_buffer, sizeof(char), program_size, fp);
-    fclose(fp);
-
-    program = clCreateProgramWithSource(context, 1, (const char**)&program_buffer, &program_size, &err);
-    if (err < 0) {
-        perror("Failed to create program. Exiting...\n");
-        exit(1);
-    }
-    free(program_buffer);
-
-    err = clBuildProgram(program, 0, NULL, "-cl-std=CL2.0", NULL, NULL);
-    if (err < 0) {
-        clGetProgramBuildInfo(program, device, CL_PROGRAM_BUILD_LOG, 0, NULL, &log_size);
-        
-        program_log = (char*)malloc(log_size + 1);
-        program_log[log_size] = '\0';
-        
-        clGetProgramBuildInfo(program, device, CL_PROGRAM_BUILD_LOG, log_size + 1, program_log, NULL);
-        
-        printf("%s\n", program_log);
-        
-        free(program_log);
-        exit(1);
-    }
+void quickSort(int* data, int low, int high) {
 
-    return program;
-}
\ No newline at end of file
+    // data-parallel device sort of data[low, high], the kernels and buffers
+    // live in the process-wide runtime and are reused between calls
+    cl_sort(data + low, high - low + 1, engine, &sort_times);
+}
@@ -1,8 +1,10 @@
 #include <iostream>
 #include <stdlib.h>
+#include <string.h>
 #include <chrono>
 #include <mpi.h>
 #include <omp.h>
+#include "../../../common/sample_sort.h"
 
 using namespace std;
 using namespace chrono;
@@ -46,8 +48,16 @@ int main(int argc, char** argv) {
 
     MPI_Init(&argc, &argv);
 
+    // element count, --gather collects the sorted array on rank 0 and checks it there too,
+    // --root-merge gathers every rank's sorted block on rank 0 and k-way merges them there
     int el_count = 10;
-    if (argc > 1) el_count = atoi(argv[1]);
+    bool gather = false;
+    bool root_merge = false;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--gather") == 0) gather = true;
+        else if (strcmp(argv[i], "--root-merge") == 0) root_merge = true;
+        else el_count = atoi(argv[i]);
+    }
 
     int max_el = el_count * 10;
 
@@ -59,114 +69,109 @@ int main(int argc, char** argv) {
     int rank;
     MPI_Comm_rank(MPI_COMM_WORLD, &rank);
 
-    // enforce 2 nodes
-    if (np != 2)
-    {
-        if (rank == 0)
-            perror("Error: Number of MPI nodes must be 2. Exiting... ");
-        
-        exit(1);
+    // calculate send counts and displacements, any number of ranks
+    int* send_counts = (int*)malloc(np * sizeof(int));
+    int* displacements = (int*)malloc(np * sizeof(int));
+    for (int r = 0, offset = 0; r < np; r++) {
+        send_counts[r] = el_count / np + (r < el_count % np ? 1 : 0);
+        displacements[r] = offset;
+        offset += send_counts[r];
     }
 
-    // calculate send counts and displacements
-    int elems_per_process = el_count / 2;
-    
-    int send_counts[2] = {elems_per_process, elems_per_process};
-    if (el_count % 2 == 1) send_counts[0] += 1;
-
-    int displacements[2] = {0, send_counts[0]};
-
-    int *data;
     int my_el_count = send_counts[rank];
+    int* data;
+    uint64_t input_hash = 0;
 
     if (rank == 0) {
-        
-        // generate random array
-        int* data = (int*)malloc(el_count * sizeof(int));
+
+        // generate random array, with its order-independent hash for the permutation check
+        data = (int*)malloc(el_count * sizeof(int));
         for (int i = 0; i < el_count; i++) {
             data[i] = rand() % (max_el - 1) + 1;
+            input_hash += sort_key_hash(data[i]);
         }
+    }
+    else {
+        data = (int*)malloc((my_el_count > 0 ? my_el_count : 1) * sizeof(int));
+    }
 
-        // start timing
-        high_resolution_clock::time_point t_start = high_resolution_clock::now();
-
-        // scatter (send) data
-        MPI_Scatterv(data, send_counts, displacements, MPI_INT, MPI_IN_PLACE, send_counts[rank], MPI_INT, 0, MPI_COMM_WORLD);
-        MPI_Barrier(MPI_COMM_WORLD);
-
-        // quicksort my elements
-        quickSort(data, 0, my_el_count - 1);
-
-        // gather (receive) data
-        MPI_Gatherv(MPI_IN_PLACE, send_counts[rank], MPI_INT, data, send_counts, displacements, MPI_INT, 0, MPI_COMM_WORLD);
-        MPI_Barrier(MPI_COMM_WORLD);
-
-        // merge sorted data
-        int* sorted = (int*)malloc(el_count * sizeof(int));
-        int u1 = 0, u2 = displacements[1], s = 0;
-        while (u1 < displacements[1] && u2 < el_count)
-        {
-            if (data[u1] <= data[u2])
-                sorted[s++] = data[u1++];
-            else
-                sorted[s++] = data[u2++];
-        }
+    MPI_Barrier(MPI_COMM_WORLD);
+
+    // start timing
+    high_resolution_clock::time_point t_start = high_resolution_clock::now();
+
+    // scatter data
+    MPI_Scatterv(data, send_counts, displacements, MPI_INT, rank == 0 ? MPI_IN_PLACE : data, my_el_count, MPI_INT, 0, MPI_COMM_WORLD);
+
+    // sample sort, every rank ends up with one sorted bucket of the whole array,
+    // or with --root-merge rank 0 ends up with all of it
+    int bucket_count;
+    sample_sort_times times;
+    int* bucket;
+    if (root_merge)
+        bucket = gather_merge_sort(data, send_counts, displacements, quickSort, MPI_COMM_WORLD, &bucket_count, &times);
+    else
+        bucket = sample_sort(data, my_el_count, quickSort, MPI_COMM_WORLD, &bucket_count, &times);
+    MPI_Barrier(MPI_COMM_WORLD);
 
-        while (u1 < displacements[1])
-            sorted[s++] = data[u1++];
+    // stop timing
+    high_resolution_clock::time_point t_stop = high_resolution_clock::now();
 
-        while (u2 < el_count)
-            sorted[s++] = data[u2++];
+    // slowest rank per phase, and the bucket balance
+    double phases[3] = {times.local_sort, times.exchange, times.merge};
+    double max_phases[3];
+    MPI_Reduce(phases, max_phases, 3, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
 
-        // stop timing
-        high_resolution_clock::time_point t_stop = high_resolution_clock::now();
+    int min_bucket, max_bucket;
+    MPI_Reduce(&bucket_count, &min_bucket, 1, MPI_INT, MPI_MIN, 0, MPI_COMM_WORLD);
+    MPI_Reduce(&bucket_count, &max_bucket, 1, MPI_INT, MPI_MAX, 0, MPI_COMM_WORLD);
+
+    // check every key of the distributed result
+    high_resolution_clock::time_point v_start = high_resolution_clock::now();
+    bool valid = sample_sort_verify(bucket, bucket_count, el_count, input_hash, MPI_COMM_WORLD);
+    duration<double> verify_time = duration_cast<duration<double>>(high_resolution_clock::now() - v_start);
+
+    if (rank == 0) {
 
         // calculate execution time
         duration<double> exec_time = duration_cast<duration<double>>(t_stop - t_start);
         cout << "Sort completed in " << exec_time.count() << " seconds." << endl;
-
-        // Validity Test (10 Samples)
-        int span = el_count / 10;
-        bool fail = false;
-        printf("Validity Test (10 Samples): \n");
-        for (int i = 0; i < 10; i++) {
-            printf("%d ", sorted[i*span]);
-            if (i > 0) {
-                if (sorted[i*span] < sorted[(i-1)*span]) {
-                    printf("<-- FAIL");
-                    fail = true;
-                    break;
-                }
-            }
-        }
-        if (fail == false) {
-            printf(": PASS");
-        }
-        printf("\n");
-
-        // clean up data
-        free(sorted);
-        free(data);
+        cout << "Local Sort Time:\t" << max_phases[0] << endl;
+        cout << (root_merge ? "Gather Time:\t" : "Exchange Time:\t") << max_phases[1] << endl;
+        cout << "Merge Time:\t" << max_phases[2] << "\t(" << kway_merge_threads() << " threads)" << endl;
+        if (!root_merge)
+            cout << "Bucket Sizes:\t" << min_bucket << " - " << max_bucket << " (average " << el_count / np << ")" << endl;
+        printf("Validity Test (%d elements, order and multiset hash): %s\n", el_count, valid ? "PASS" : "FAIL");
+        cout << "Verify Time:\t" << verify_time.count() << "\t(" << 100 * verify_time.count() / exec_time.count() << "% of sort)" << endl;
     }
-    else
-    {
-        int* data = (int*)malloc(my_el_count * sizeof(int));
 
-        // scatter (receive) data
-        MPI_Scatterv(data, send_counts, displacements, MPI_INT, data, send_counts[rank], MPI_INT, 0, MPI_COMM_WORLD);
-        MPI_Barrier(MPI_COMM_WORLD);
+    // optionally collect the buckets, in rank order they are the sorted array
+    if (gather) {
+        int* bucket_counts = (int*)malloc(np * sizeof(int));
+        int* bucket_displacements = (int*)malloc(np * sizeof(int));
+        MPI_Gather(&bucket_count, 1, MPI_INT, bucket_counts, 1, MPI_INT, 0, MPI_COMM_WORLD);
+        for (int r = 0, offset = 0; rank == 0 && r < np; r++) {
+            bucket_displacements[r] = offset;
+            offset += bucket_counts[r];
+        }
 
-        // quicksort my elements
-        quickSort(data, 0, my_el_count - 1);
+        MPI_Gatherv(bucket, bucket_count, MPI_INT, data, bucket_counts, bucket_displacements, MPI_INT, 0, MPI_COMM_WORLD);
 
-        // gather (send) data
-        MPI_Gatherv(data, send_counts[rank], MPI_INT, data, send_counts, displacements, MPI_INT, 0, MPI_COMM_WORLD);
-        MPI_Barrier(MPI_COMM_WORLD);
+        if (rank == 0) {
+            bool sorted = sort_verify(data, el_count, input_hash, sort_verify_threads());
+            printf("Gathered Validity Test (%d elements): %s\n", el_count, sorted ? "PASS" : "FAIL");
+        }
 
-        // clean up memory
-        free(data);
+        free(bucket_displacements);
+        free(bucket_counts);
     }
 
+    // clean up memory
+    free(bucket);
+    free(data);
+    free(displacements);
+    free(send_counts);
+
     MPI_Finalize();
     return 0;
 }
\ No newline at end of file
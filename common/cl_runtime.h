@@ -0,0 +1,352 @@
+#ifndef CL_RUNTIME_H
+#define CL_RUNTIME_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <map>
+#include <string>
+#include <vector>
+
+// the 1.2 api is the baseline, 2.0+ entry points are only used when both the
+// headers and the platform have them. clCreateCommandQueue is the 1.2 way to
+// make a queue and stays available (deprecated) in newer headers.
+#ifndef CL_TARGET_OPENCL_VERSION
+#define CL_TARGET_OPENCL_VERSION 120
+#endif
+#ifndef CL_USE_DEPRECATED_OPENCL_1_2_APIS
+#define CL_USE_DEPRECATED_OPENCL_1_2_APIS
+#endif
+#include <CL/cl.h>
+
+// Process-lifetime OpenCL state. The first call to cl_runtime_get() picks the
+// device and creates the context and an in-order, profiling-enabled queue.
+// Programs and kernels are built once per (file, options) and looked up by
+// name afterwards, and buffers are handed out from a pool so repeated calls do
+// not re-allocate device memory. Compiled programs are also cached on disk in
+// CL_CACHE_DIR as CL_PROGRAM_BINARIES, keyed by a hash of the device, driver,
+// source and build options, so later runs skip clBuildProgram from source.
+// Call cl_runtime_shutdown() before exit to release everything.
+
+#define CL_CACHE_DIR ".cl_cache"
+
+struct cl_pool_buffer {
+    cl_mem mem;
+    size_t bytes;
+    cl_mem_flags flags;
+    bool in_use;
+};
+
+struct cl_runtime {
+    cl_device_id device;
+    cl_context context;
+    cl_command_queue queue;
+    std::map<std::string, cl_program> programs;     // by file and build options
+    std::map<std::string, cl_kernel> kernels;       // by program key and kernel name
+    std::vector<cl_pool_buffer> buffers;
+    int source_builds;                              // programs built from source
+    int cache_loads;                                // programs loaded from the binary cache
+    int cache_saves;                                // binaries written to the cache
+};
+
+// fnv-1a, for cache keys
+static inline uint64_t cl_runtime_hash(uint64_t h, const void* data, size_t bytes) {
+
+    const unsigned char* p = (const unsigned char*)data;
+    for (size_t i = 0; i < bytes; i++) h = (h ^ p[i]) * 0x100000001b3ull;
+    return h;
+}
+
+static inline uint64_t cl_runtime_hash(uint64_t h, const std::string &s) {
+    return cl_runtime_hash(h, s.data(), s.size() + 1);
+}
+
+static inline std::string cl_device_string(cl_device_id device, cl_uint param) {
+
+    char value[256] = "";
+    clGetDeviceInfo(device, param, sizeof(value), value, NULL);
+    return value;
+}
+
+// gpu if there is one, otherwise cpu
+static inline cl_device_id cl_runtime_device() {
+
+    cl_int          err;
+    cl_platform_id  platform;
+    cl_device_id    device;
+
+    err = clGetPlatformIDs(1, &platform, NULL);
+    if (err < 0) {
+        perror("Failed to identify a platform. Exiting...\n");
+        exit(1);
+    }
+
+    err = clGetDeviceIDs(platform, CL_DEVICE_TYPE_GPU, 1, &device, NULL);
+    if (err < 0) {
+        perror("Failed to access GPU device. Attempting CPU...\n");
+        err = clGetDeviceIDs(platform, CL_DEVICE_TYPE_CPU, 1, &device, NULL);
+    }
+    if (err < 0) {
+        perror("Failed to access CPU device. No devices available. Exiting...\n");
+        exit(1);
+    }
+
+    return device;
+}
+
+// major version of the opencl platform a device belongs to, from "OpenCL <major>.<minor> ..."
+static inline int cl_platform_major(cl_device_id device) {
+
+    cl_platform_id platform;
+    if (clGetDeviceInfo(device, CL_DEVICE_PLATFORM, sizeof(platform), &platform, NULL) < 0) return 1;
+
+    char version[256] = "";
+    int major = 1, minor = 0;
+    clGetPlatformInfo(platform, CL_PLATFORM_VERSION, sizeof(version), version, NULL);
+    sscanf(version, "OpenCL %d.%d", &major, &minor);
+    return major;
+}
+
+// device time of a finished command from its profiling info, 0 without an event
+static inline double cl_event_seconds(cl_event event) {
+
+    if (event == NULL) return 0;
+    cl_ulong start = 0, end = 0;
+    clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_START, sizeof(start), &start, NULL);
+    clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_END, sizeof(end), &end, NULL);
+    return end > start ? (end - start) * 1e-9 : 0;
+}
+
+// the one runtime of this process, not yet set up until cl_runtime_get()
+static inline cl_runtime& cl_runtime_state() {
+
+    static cl_runtime rt = {NULL, NULL, NULL, {}, {}, {}, 0, 0, 0};
+    return rt;
+}
+
+static inline cl_runtime& cl_runtime_get() {
+
+    cl_runtime &rt = cl_runtime_state();
+    if (rt.context != NULL) return rt;
+
+    cl_int err;
+    rt.device = cl_runtime_device();
+
+    rt.context = clCreateContext(NULL, 1, &rt.device, NULL, NULL, &err);
+    if (err < 0) {
+        perror("Failed to create context. Exiting...\n");
+        exit(1);
+    }
+
+    // clCreateCommandQueueWithProperties only exists on 2.0+ platforms, 1.x
+    // icds either lack it or return CL_INVALID_OPERATION
+    rt.queue = NULL;
+#ifdef CL_VERSION_2_0
+    if (cl_platform_major(rt.device) >= 2) {
+        const cl_queue_properties properties[] = {CL_QUEUE_PROPERTIES, CL_QUEUE_PROFILING_ENABLE, 0};
+        rt.queue = clCreateCommandQueueWithProperties(rt.context, rt.device, properties, &err);
+    }
+#endif
+    if (rt.queue == NULL) rt.queue = clCreateCommandQueue(rt.context, rt.device, CL_QUEUE_PROFILING_ENABLE, &err);
+    if (rt.queue == NULL || err < 0) {
+        perror("Failed to create command queue. Exiting...\n");
+        exit(1);
+    }
+
+    return rt;
+}
+
+static inline bool cl_read_file(const char* filename, std::string &contents) {
+
+    FILE* fp = fopen(filename, "rb");
+    if (fp == NULL) return false;
+
+    fseek(fp, 0, SEEK_END);
+    long size = ftell(fp);
+    rewind(fp);
+
+    contents.resize(size > 0 ? size : 0);
+    bool ok = size >= 0 && fread(&contents[0], 1, contents.size(), fp) == contents.size();
+    fclose(fp);
+    return ok;
+}
+
+// try the binary cache, NULL on a miss or if the driver rejects the binary
+static inline cl_program cl_runtime_load_binary(cl_runtime &rt, const std::string &path, const char* options) {
+
+    std::string binary;
+    if (!cl_read_file(path.c_str(), binary) || binary.empty()) return NULL;
+
+    const unsigned char* data = (const unsigned char*)binary.data();
+    size_t size = binary.size();
+    cl_int status, err;
+
+    cl_program program = clCreateProgramWithBinary(rt.context, 1, &rt.device, &size, &data, &status, &err);
+    if (err < 0 || status < 0) {
+        if (program != NULL) clReleaseProgram(program);
+        return NULL;
+    }
+
+    if (clBuildProgram(program, 1, &rt.device, options, NULL, NULL) < 0) {
+        clReleaseProgram(program);
+        return NULL;
+    }
+    return program;
+}
+
+// write the program's binary to path, via a temporary file so concurrent ranks never see a partial one
+static inline void cl_runtime_save_binary(cl_runtime &rt, cl_program program, const std::string &path) {
+
+    size_t size = 0;
+    if (clGetProgramInfo(program, CL_PROGRAM_BINARY_SIZES, sizeof(size), &size, NULL) < 0 || size == 0) return;
+
+    std::vector<unsigned char> binary(size);
+    unsigned char* data = binary.data();
+    if (clGetProgramInfo(program, CL_PROGRAM_BINARIES, sizeof(data), &data, NULL) < 0) return;
+
+    mkdir(CL_CACHE_DIR, 0755);
+    std::string tmp = path + "." + std::to_string(getpid());
+    FILE* fp = fopen(tmp.c_str(), "wb");
+    if (fp == NULL) return;
+
+    bool ok = fwrite(data, 1, size, fp) == size;
+    ok = fclose(fp) == 0 && ok;
+    if (ok && rename(tmp.c_str(), path.c_str()) == 0) rt.cache_saves++;
+    else unlink(tmp.c_str());
+}
+
+// program built from filename with options, from memory, the binary cache or source
+static inline cl_program cl_runtime_program(cl_runtime &rt, const char* filename, const char* options) {
+
+    std::string key = std::string(filename) + "|" + options;
+    auto found = rt.programs.find(key);
+    if (found != rt.programs.end()) return found->second;
+
+    std::string source;
+    if (!cl_read_file(filename, source)) {
+        perror("Failed to open program file. Exiting...\n");
+        exit(1);
+    }
+
+    uint64_t h = 0xcbf29ce484222325ull;
+    h = cl_runtime_hash(h, cl_device_string(rt.device, CL_DEVICE_NAME));
+    h = cl_runtime_hash(h, cl_device_string(rt.device, CL_DEVICE_VERSION));
+    h = cl_runtime_hash(h, cl_device_string(rt.device, CL_DRIVER_VERSION));
+    h = cl_runtime_hash(h, std::string(options));
+    h = cl_runtime_hash(h, source);
+
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx.bin", (unsigned long long)h);
+    std::string path = std::string(CL_CACHE_DIR) + "/" + name;
+
+    cl_program program = cl_runtime_load_binary(rt, path, options);
+    if (program != NULL) {
+        rt.cache_loads++;
+    }
+    else {
+        cl_int err;
+        const char* text = source.c_str();
+        size_t size = source.size();
+
+        program = clCreateProgramWithSource(rt.context, 1, &text, &size, &err);
+        if (err < 0) {
+            perror("Failed to create program. Exiting...\n");
+            exit(1);
+        }
+
+        err = clBuildProgram(program, 1, &rt.device, options, NULL, NULL);
+        if (err < 0) {
+            size_t log_size;
+            clGetProgramBuildInfo(program, rt.device, CL_PROGRAM_BUILD_LOG, 0, NULL, &log_size);
+
+            char* program_log = (char*)malloc(log_size + 1);
+            program_log[log_size] = '\0';
+            clGetProgramBuildInfo(program, rt.device, CL_PROGRAM_BUILD_LOG, log_size + 1, program_log, NULL);
+            printf("%s\n", program_log);
+
+            free(program_log);
+            exit(1);
+        }
+
+        rt.source_builds++;
+        cl_runtime_save_binary(rt, program, path);
+    }
+
+    rt.programs[key] = program;
+    return program;
+}
+
+// kernel name from filename built with options, created once and reused.
+// kernel arguments persist between calls, so callers set all of them every time.
+static inline cl_kernel cl_runtime_kernel(cl_runtime &rt, const char* filename, const char* options, const char* name) {
+
+    std::string key = std::string(filename) + "|" + options + "|" + name;
+    auto found = rt.kernels.find(key);
+    if (found != rt.kernels.end()) return found->second;
+
+    cl_int err;
+    cl_kernel kernel = clCreateKernel(cl_runtime_program(rt, filename, options), name, &err);
+    if (err < 0) {
+        perror("Failed to create kernel. Exiting...\n");
+        exit(1);
+    }
+
+    rt.kernels[key] = kernel;
+    return kernel;
+}
+
+// smallest free pooled buffer with these flags that holds bytes, or a new one
+static inline cl_mem cl_runtime_buffer(cl_runtime &rt, cl_mem_flags flags, size_t bytes) {
+
+    cl_pool_buffer* best = NULL;
+    for (cl_pool_buffer &buffer : rt.buffers) {
+        if (buffer.in_use || buffer.flags != flags || buffer.bytes < bytes) continue;
+        if (best == NULL || buffer.bytes < best->bytes) best = &buffer;
+    }
+    if (best != NULL) {
+        best->in_use = true;
+        return best->mem;
+    }
+
+    cl_int err;
+    cl_mem mem = clCreateBuffer(rt.context, flags, bytes > 0 ? bytes : 1, NULL, &err);
+    if (err < 0) {
+        perror("Failed to create buffer. Exiting...\n");
+        exit(1);
+    }
+
+    cl_pool_buffer buffer = {mem, bytes, flags, true};
+    rt.buffers.push_back(buffer);
+    return mem;
+}
+
+// return a buffer to the pool, commands using it must be enqueued already
+static inline void cl_runtime_release(cl_runtime &rt, cl_mem mem) {
+
+    for (cl_pool_buffer &buffer : rt.buffers)
+        if (buffer.mem == mem) buffer.in_use = false;
+}
+
+static inline void cl_runtime_shutdown() {
+
+    cl_runtime &rt = cl_runtime_state();
+    if (rt.context == NULL) return;
+    clFinish(rt.queue);
+
+    for (cl_pool_buffer &buffer : rt.buffers) clReleaseMemObject(buffer.mem);
+    for (auto &kernel : rt.kernels) clReleaseKernel(kernel.second);
+    for (auto &program : rt.programs) clReleaseProgram(program.second);
+    rt.buffers.clear();
+    rt.kernels.clear();
+    rt.programs.clear();
+
+    clReleaseCommandQueue(rt.queue);
+    clReleaseContext(rt.context);
+    rt.queue = NULL;
+    rt.context = NULL;
+}
+
+#endif
@@ -0,0 +1,191 @@
+#ifndef CL_SORT_H
+#define CL_SORT_H
+
+#include <limits.h>
+#include <vector>
+#include "cl_runtime.h"
+
+// Device sort of 32-bit int keys on the OpenCL 1.2 kernels in
+// CL_SORT_KERNELS: an LSD radix sort (histogram, scan and scatter per 8-bit
+// digit, four passes ping-ponging between two buffers), or a bitonic network
+// for small inputs and as a fallback engine. Everything goes through the
+// process-wide cl_runtime, so kernels are built once and buffers are pooled.
+
+#ifndef CL_SORT_KERNELS
+#define CL_SORT_KERNELS "qs-kernel.cl"
+#endif
+
+#define CL_SORT_RADIX 0
+#define CL_SORT_BITONIC 1
+
+// keys per radix work-item at least, and at most this many work-items
+#define CL_SORT_RADIX_CHUNK 4096
+#define CL_SORT_RADIX_CHUNKS 1024
+
+// work-items of the single work-group scan
+#define CL_SORT_SCAN_ITEMS 256
+
+// inputs this small always use the bitonic network, and larger than the
+// limit never do
+#define CL_SORT_BITONIC_MAX 4096
+#define CL_SORT_BITONIC_LIMIT (1 << 29)
+
+// device seconds per stage, from profiling events
+struct cl_sort_times {
+    double upload;
+    double sort;        // all kernels
+    double download;
+};
+
+static inline const char* cl_sort_engine_name(int engine) {
+    return engine == CL_SORT_BITONIC ? "bitonic" : "radix";
+}
+
+// engine actually used for n keys
+static inline int cl_sort_engine(int engine, int n) {
+    if (n <= CL_SORT_BITONIC_MAX) return CL_SORT_BITONIC;
+    // the stage size k doubles up to padded and once more to end the loop, and
+    // is an int on the host and in bitonic_step, so padded stays <= 2^29
+    if (n > CL_SORT_BITONIC_LIMIT) return CL_SORT_RADIX;
+    return engine;
+}
+
+// build (or load from the binary cache) every sort kernel, to keep it out of timings
+static inline void cl_sort_build() {
+
+    cl_runtime &rt = cl_runtime_get();
+    for (const char* name : {"radix_histogram", "radix_scan", "radix_scatter", "bitonic_step"})
+        cl_runtime_kernel(rt, CL_SORT_KERNELS, "-cl-std=CL1.2", name);
+}
+
+// enqueue a 1d kernel and keep its event for the timing sum
+static inline void cl_sort_launch(cl_runtime &rt, cl_kernel kernel, size_t global, size_t local, std::vector<cl_event> &events) {
+
+    cl_event event;
+    cl_int err = clEnqueueNDRangeKernel(rt.queue, kernel, 1, NULL, &global, local > 0 ? &local : NULL, 0, NULL, &event);
+    if (err < 0) {
+        perror("Failed to enqueue sort kernel. Exiting...\n");
+        exit(1);
+    }
+    events.push_back(event);
+}
+
+static inline void cl_sort_radix(cl_runtime &rt, cl_mem keys, cl_mem sorted, int n, std::vector<cl_event> &events) {
+
+    const char* options = "-cl-std=CL1.2";
+    cl_kernel histogram = cl_runtime_kernel(rt, CL_SORT_KERNELS, options, "radix_histogram");
+    cl_kernel scan = cl_runtime_kernel(rt, CL_SORT_KERNELS, options, "radix_scan");
+    cl_kernel scatter = cl_runtime_kernel(rt, CL_SORT_KERNELS, options, "radix_scatter");
+
+    // one contiguous chunk of keys per work-item
+    int chunks = n / CL_SORT_RADIX_CHUNK;
+    if (chunks < 1) chunks = 1;
+    if (chunks > CL_SORT_RADIX_CHUNKS) chunks = CL_SORT_RADIX_CHUNKS;
+    int chunk = (n + chunks - 1) / chunks;
+    chunks = (n + chunk - 1) / chunk;
+    int bins = 256 * chunks;
+
+    size_t scan_items = CL_SORT_SCAN_ITEMS;
+    size_t max_items = 0;
+    clGetKernelWorkGroupInfo(scan, rt.device, CL_KERNEL_WORK_GROUP_SIZE, sizeof(max_items), &max_items, NULL);
+    if (max_items > 0 && max_items < scan_items) scan_items = max_items;
+
+    cl_mem counts = cl_runtime_buffer(rt, CL_MEM_READ_WRITE, bins * sizeof(cl_uint));
+
+    // four 8-bit passes, an even count so the result ends up back in keys
+    for (int shift = 0; shift < 32; shift += 8) {
+        clSetKernelArg(histogram, 0, sizeof(cl_mem), &keys);
+        clSetKernelArg(histogram, 1, sizeof(int), &n);
+        clSetKernelArg(histogram, 2, sizeof(int), &chunk);
+        clSetKernelArg(histogram, 3, sizeof(int), &shift);
+        clSetKernelArg(histogram, 4, sizeof(cl_mem), &counts);
+        cl_sort_launch(rt, histogram, chunks, 0, events);
+
+        clSetKernelArg(scan, 0, sizeof(cl_mem), &counts);
+        clSetKernelArg(scan, 1, sizeof(int), &bins);
+        clSetKernelArg(scan, 2, scan_items * sizeof(cl_uint), NULL);
+        cl_sort_launch(rt, scan, scan_items, scan_items, events);
+
+        clSetKernelArg(scatter, 0, sizeof(cl_mem), &keys);
+        clSetKernelArg(scatter, 1, sizeof(cl_mem), &sorted);
+        clSetKernelArg(scatter, 2, sizeof(int), &n);
+        clSetKernelArg(scatter, 3, sizeof(int), &chunk);
+        clSetKernelArg(scatter, 4, sizeof(int), &shift);
+        clSetKernelArg(scatter, 5, sizeof(cl_mem), &counts);
+        cl_sort_launch(rt, scatter, chunks, 0, events);
+
+        cl_mem swap = keys;
+        keys = sorted;
+        sorted = swap;
+    }
+
+    cl_runtime_release(rt, counts);
+}
+
+// keys holds padded (a power of two) elements
+static inline void cl_sort_bitonic(cl_runtime &rt, cl_mem keys, int padded, std::vector<cl_event> &events) {
+
+    cl_kernel step = cl_runtime_kernel(rt, CL_SORT_KERNELS, "-cl-std=CL1.2", "bitonic_step");
+
+    for (int k = 2; k <= padded; k <<= 1)
+    for (int j = k >> 1; j > 0; j >>= 1) {
+        clSetKernelArg(step, 0, sizeof(cl_mem), &keys);
+        clSetKernelArg(step, 1, sizeof(int), &j);
+        clSetKernelArg(step, 2, sizeof(int), &k);
+        cl_sort_launch(rt, step, padded, 0, events);
+    }
+}
+
+// sort data[0, n) ascending in place on the device
+static inline void cl_sort(int* data, int n, int engine, cl_sort_times* times) {
+
+    times->upload = times->sort = times->download = 0;
+    if (n <= 1) return;
+
+    cl_runtime &rt = cl_runtime_get();
+    engine = cl_sort_engine(engine, n);
+    size_t bytes = (size_t)n * sizeof(int);
+
+    std::vector<cl_event> events;
+    cl_event upload = NULL, download = NULL;
+    cl_mem keys, sorted = NULL;
+
+    if (engine == CL_SORT_RADIX) {
+        keys = cl_runtime_buffer(rt, CL_MEM_READ_WRITE, bytes);
+        sorted = cl_runtime_buffer(rt, CL_MEM_READ_WRITE, bytes);
+        clEnqueueWriteBuffer(rt.queue, keys, CL_FALSE, 0, bytes, data, 0, NULL, &upload);
+        cl_sort_radix(rt, keys, sorted, n, events);
+    }
+    else {
+        // pad to a power of two with keys that sort last
+        int padded = 1;
+        while (padded < n) padded <<= 1;
+        keys = cl_runtime_buffer(rt, CL_MEM_READ_WRITE, (size_t)padded * sizeof(int));
+        clEnqueueWriteBuffer(rt.queue, keys, CL_FALSE, 0, bytes, data, 0, NULL, &upload);
+        if (padded > n) {
+            int pad = INT_MAX;
+            cl_event fill;
+            clEnqueueFillBuffer(rt.queue, keys, &pad, sizeof(pad), bytes, (size_t)(padded - n) * sizeof(int), 0, NULL, &fill);
+            events.push_back(fill);
+        }
+        cl_sort_bitonic(rt, keys, padded, events);
+    }
+
+    // the queue is in order, so the read follows the last kernel
+    clEnqueueReadBuffer(rt.queue, keys, CL_FALSE, 0, bytes, data, 0, NULL, &download);
+    clWaitForEvents(1, &download);
+
+    times->upload = cl_event_seconds(upload);
+    times->download = cl_event_seconds(download);
+    for (cl_event event : events) {
+        times->sort += cl_event_seconds(event);
+        clReleaseEvent(event);
+    }
+    clReleaseEvent(upload);
+    clReleaseEvent(download);
+
+    cl_runtime_release(rt, keys);
+    if (sorted != NULL) cl_runtime_release(rt, sorted);
+}
+
+#endif
@@ -0,0 +1,318 @@
+#ifndef GEMM_H
+#define GEMM_H
+
+#include <stdlib.h>
+#include <string.h>
+#include "matrix.h"
+
+// register block, each micro-kernel call produces a GEMM_MR x GEMM_NR block of c
+#define GEMM_MR 4
+#define GEMM_NR 16
+
+// cache blocks
+//  - a packed GEMM_KC x GEMM_NR micro-panel of b stays in L1
+//  - a packed GEMM_MC x GEMM_KC block of a stays in L2
+//  - a packed GEMM_KC x GEMM_NC panel of b stays in L3
+#define GEMM_KC 256
+#define GEMM_MC 128
+#define GEMM_NC 4096
+
+#include "gemm_simd.h"
+
+static inline int gemm_min(int a, int b) {
+    return a < b ? a : b;
+}
+
+template <class T>
+static inline T* gemm_alloc(size_t count) {
+
+    // round up to a whole number of cache lines for aligned_alloc
+    size_t bytes = (count * sizeof(T) + MATRIX_ALIGN - 1) & ~(size_t)(MATRIX_ALIGN - 1);
+    return (T*)aligned_alloc(MATRIX_ALIGN, bytes);
+}
+
+// pack a[row..row+mc)[k..k+kc) into GEMM_MR row micro-panels, k-major,
+// zero padding the last panel so the micro-kernel never branches
+template <class T>
+static inline void gemm_pack_a(const T* a, int lda, int row, int k, int mc, int kc, T* packed) {
+
+    for (int i = 0; i < mc; i += GEMM_MR) {
+        int mr = gemm_min(GEMM_MR, mc - i);
+        for (int p = 0; p < kc; p++) {
+            for (int ii = 0; ii < mr; ii++)
+                *packed++ = a[(size_t)(row + i + ii) * lda + k + p];
+            for (int ii = mr; ii < GEMM_MR; ii++)
+                *packed++ = 0;
+        }
+    }
+}
+
+// pack b[k..k+kc)[col..col+nc) into GEMM_NR column micro-panels, k-major,
+// zero padding the last panel
+template <class T>
+static inline void gemm_pack_b(const T* b, int ldb, int k, int col, int kc, int nc, T* packed) {
+
+    for (int j = 0; j < nc; j += GEMM_NR) {
+        int nr = gemm_min(GEMM_NR, nc - j);
+        for (int p = 0; p < kc; p++) {
+            const T* src = &b[(size_t)(k + p) * ldb + col + j];
+            for (int jj = 0; jj < nr; jj++)
+                *packed++ = src[jj];
+            for (int jj = nr; jj < GEMM_NR; jj++)
+                *packed++ = 0;
+        }
+    }
+}
+
+// c[0..mr)[0..nr) += packed a micro-panel * packed b micro-panel, c has row stride ldc
+template <class T>
+static inline void gemm_micro_kernel(int kc, const T* a, const T* b, T* c, int ldc, int mr, int nr) {
+
+    T acc[GEMM_MR][GEMM_NR] = {{0}};
+
+    for (int p = 0; p < kc; p++) {
+        for (int i = 0; i < GEMM_MR; i++) {
+            T a_ip = a[i];
+            for (int j = 0; j < GEMM_NR; j++)
+                acc[i][j] += a_ip * b[j];
+        }
+        a += GEMM_MR;
+        b += GEMM_NR;
+    }
+
+    for (int i = 0; i < mr; i++)
+    for (int j = 0; j < nr; j++)
+        c[(size_t)i * ldc + j] += acc[i][j];
+}
+
+template <class T>
+using gemm_kernel_t = void (*)(int, const T*, const T*, T*, int, int, int);
+
+// micro-kernel for the active isa, the portable kernel for types without a vector one
+template <class T>
+static inline gemm_kernel_t<T> gemm_select_kernel(const T*) {
+    return gemm_micro_kernel<T>;
+}
+
+static inline gemm_kernel_t<int32_t> gemm_select_kernel(const int32_t*) {
+
+#ifdef GEMM_X86
+    if (gemm_isa() == GEMM_ISA_AVX512) return gemm_kernel_i32_avx512;
+    if (gemm_isa() == GEMM_ISA_AVX2) return gemm_kernel_i32_avx2;
+#endif
+    return gemm_micro_kernel<int32_t>;
+}
+
+// true if every element of m[row_start..row_end)[col_start..col_end) fits in an int16
+static inline bool gemm_fits_int16(const int32_t* m, int ld, int row_start, int row_end, int col_start, int col_end) {
+
+    for (int r = row_start; r < row_end; r++) {
+        const int32_t* row = &m[(size_t)r * ld];
+        int32_t lo = 0, hi = 0;
+        for (int c = col_start; c < col_end; c++) {
+            lo = row[c] < lo ? row[c] : lo;
+            hi = row[c] > hi ? row[c] : hi;
+        }
+        if (lo < INT16_MIN || hi > INT16_MAX) return false;
+    }
+
+    return true;
+}
+
+// as gemm_pack_a, but int16 with consecutive k values interleaved in pairs
+static inline void gemm_pack_a_i16(const int32_t* a, int lda, int row, int k, int mc, int kc, int16_t* packed) {
+
+    for (int i = 0; i < mc; i += GEMM_MR) {
+        int mr = gemm_min(GEMM_MR, mc - i);
+        for (int p = 0; p < kc; p += 2) {
+            for (int ii = 0; ii < GEMM_MR; ii++) {
+                const int32_t* src = &a[(size_t)(row + i + ii) * lda + k + p];
+                *packed++ = ii < mr ? (int16_t)src[0] : 0;
+                *packed++ = ii < mr && p + 1 < kc ? (int16_t)src[1] : 0;
+            }
+        }
+    }
+}
+
+// as gemm_pack_b, but int16 with consecutive k values interleaved in pairs
+static inline void gemm_pack_b_i16(const int32_t* b, int ldb, int k, int col, int kc, int nc, int16_t* packed) {
+
+    for (int j = 0; j < nc; j += GEMM_NR) {
+        int nr = gemm_min(GEMM_NR, nc - j);
+        for (int p = 0; p < kc; p += 2) {
+            const int32_t* src0 = &b[(size_t)(k + p) * ldb + col + j];
+            const int32_t* src1 = src0 + ldb;
+            for (int jj = 0; jj < GEMM_NR; jj++) {
+                *packed++ = jj < nr ? (int16_t)src0[jj] : 0;
+                *packed++ = jj < nr && p + 1 < kc ? (int16_t)src1[jj] : 0;
+            }
+        }
+    }
+}
+
+// int32 tiles whose inputs fit in int16 run on the madd kernels, which do two
+// multiply-accumulates per lane per instruction. returns false if not applicable.
+template <class T>
+static inline bool gemm_tile_narrow(const T*, int, const T*, int, T*, int, int, int, int, int, int) {
+    return false;
+}
+
+static inline bool gemm_tile_narrow(const int32_t* a, int lda, const int32_t* b, int ldb, int32_t* c, int ldc, int k,
+                                    int row_start, int row_end, int col_start, int col_end) {
+
+#ifdef GEMM_X86
+    if (!gemm_narrow_enabled || gemm_isa() == GEMM_ISA_SCALAR) return false;
+    if (!gemm_fits_int16(a, lda, row_start, row_end, 0, k)) return false;
+    if (!gemm_fits_int16(b, ldb, 0, k, col_start, col_end)) return false;
+
+    void (*kernel)(int, const int16_t*, const int16_t*, int32_t*, int, int, int) =
+        gemm_isa() == GEMM_ISA_AVX512 ? gemm_kernel_i16_avx512 : gemm_kernel_i16_avx2;
+
+    int tile_cols = gemm_min(GEMM_NC, col_end - col_start);
+    int16_t* packed_a = (int16_t*)gemm_alloc<int32_t>((size_t)GEMM_MC * GEMM_KC);
+    int16_t* packed_b = (int16_t*)gemm_alloc<int32_t>((size_t)GEMM_KC * (tile_cols + GEMM_NR));
+
+    for (int jc = col_start; jc < col_end; jc += GEMM_NC) {
+        int nc = gemm_min(GEMM_NC, col_end - jc);
+
+        for (int pc = 0; pc < k; pc += GEMM_KC) {
+            int kc = gemm_min(GEMM_KC, k - pc);
+            int kc2 = (kc + 1) / 2;
+            gemm_pack_b_i16(b, ldb, pc, jc, kc, nc, packed_b);
+
+            for (int ic = row_start; ic < row_end; ic += GEMM_MC) {
+                int mc = gemm_min(GEMM_MC, row_end - ic);
+                gemm_pack_a_i16(a, lda, ic, pc, mc, kc, packed_a);
+
+                for (int jr = 0; jr < nc; jr += GEMM_NR)
+                for (int ir = 0; ir < mc; ir += GEMM_MR)
+                    kernel(kc2, &packed_a[ir * kc2 * 2], &packed_b[jr * kc2 * 2], &c[(size_t)(ic + ir) * ldc + jc + jr], ldc,
+                           gemm_min(GEMM_MR, mc - ir), gemm_min(GEMM_NR, nc - jr));
+            }
+        }
+    }
+
+    free(packed_a);
+    free(packed_b);
+    return true;
+#else
+    return false;
+#endif
+}
+
+// c[row_start..row_end)[col_start..col_end) += a * b, where a has k columns and b has k rows,
+// each stored row-major with a leading dimension (row stride) of lda/ldb/ldc elements.
+// tiles are independent, so callers parallelise by handing disjoint tiles to threads.
+template <class T>
+static inline void gemm_tile(const T* a, int lda, const T* b, int ldb, T* c, int ldc, int k,
+                             int row_start, int row_end, int col_start, int col_end) {
+
+    if (gemm_tile_narrow(a, lda, b, ldb, c, ldc, k, row_start, row_end, col_start, col_end)) return;
+
+    gemm_kernel_t<T> kernel = gemm_select_kernel(a);
+
+    int tile_cols = gemm_min(GEMM_NC, col_end - col_start);
+    T* packed_a = gemm_alloc<T>((size_t)GEMM_MC * GEMM_KC);
+    T* packed_b = gemm_alloc<T>((size_t)GEMM_KC * (tile_cols + GEMM_NR));
+
+    for (int jc = col_start; jc < col_end; jc += GEMM_NC) {
+        int nc = gemm_min(GEMM_NC, col_end - jc);
+
+        for (int pc = 0; pc < k; pc += GEMM_KC) {
+            int kc = gemm_min(GEMM_KC, k - pc);
+            gemm_pack_b(b, ldb, pc, jc, kc, nc, packed_b);
+
+            for (int ic = row_start; ic < row_end; ic += GEMM_MC) {
+                int mc = gemm_min(GEMM_MC, row_end - ic);
+                gemm_pack_a(a, lda, ic, pc, mc, kc, packed_a);
+
+                for (int jr = 0; jr < nc; jr += GEMM_NR)
+                for (int ir = 0; ir < mc; ir += GEMM_MR)
+                    kernel(kc, &packed_a[ir * kc], &packed_b[jr * kc], &c[(size_t)(ic + ir) * ldc + jc + jr], ldc,
+                           gemm_min(GEMM_MR, mc - ir), gemm_min(GEMM_NR, nc - jr));
+            }
+        }
+    }
+
+    free(packed_a);
+    free(packed_b);
+}
+
+// c[row_start..row_end)[col_start..col_end) += a * b for whole matrices
+template <class T>
+static inline void gemm_tile(const Matrix<T> &a, const Matrix<T> &b, Matrix<T> &c,
+                             int row_start, int row_end, int col_start, int col_end) {
+    gemm_tile(a.data(), a.stride(), b.data(), b.stride(), c.data(), c.stride(), a.cols(),
+              row_start, row_end, col_start, col_end);
+}
+
+// An m x n output split into one tile per thread, a row_tiles x col_tiles grid
+// with row_tiles * col_tiles == threads. Splitting only by GEMM_MC row blocks
+// caps the threads at ceil(m / GEMM_MC), so the grid shape is the factoring
+// of threads with the least packing: every tile packs its rows of a and its
+// columns of b once per GEMM_KC slice, col_tiles * m + row_tiles * n elements
+// per slice in total. Ties go to more row tiles, which keeps a tile's rows of
+// c contiguous. Tile t is row tile t / col_tiles, column tile t % col_tiles,
+// so a schedule(static) loop over the tiles gives thread t tile t.
+struct gemm_partition {
+    int m, n;
+    int row_tiles, col_tiles;
+};
+
+struct gemm_range {
+    int row_start, row_end;
+    int col_start, col_end;
+};
+
+static inline gemm_partition gemm_partition_create(int m, int n, int threads) {
+
+    gemm_partition p = {m, n, 1, 1};
+    if (threads < 1) threads = 1;
+
+    long best = -1;
+    for (int rows = 1; rows <= threads; rows++) {
+        if (threads % rows != 0) continue;
+        int cols = threads / rows;
+        long packed = (long)cols * m + (long)rows * n;
+        if (best < 0 || packed <= best) {
+            best = packed;
+            p.row_tiles = rows;
+            p.col_tiles = cols;
+        }
+    }
+    return p;
+}
+
+// the same grid over another m x n matrix, e.g. the a or b of a product
+// split like its c: a's row tiles are c's row tiles, b's column tiles c's column tiles
+static inline gemm_partition gemm_partition_resize(gemm_partition p, int m, int n) {
+
+    p.m = m;
+    p.n = n;
+    return p;
+}
+
+static inline int gemm_partition_tiles(const gemm_partition &p) {
+    return p.row_tiles * p.col_tiles;
+}
+
+static inline gemm_range gemm_partition_tile(const gemm_partition &p, int t) {
+
+    int i = t / p.col_tiles, j = t % p.col_tiles;
+    gemm_range r = {(int)((long)p.m * i / p.row_tiles), (int)((long)p.m * (i + 1) / p.row_tiles),
+                    (int)((long)p.n * j / p.col_tiles), (int)((long)p.n * (j + 1) / p.col_tiles)};
+    return r;
+}
+
+// c += a * b
+template <class T>
+static inline void gemm(const Matrix<T> &a, const Matrix<T> &b, Matrix<T> &c) {
+    gemm_tile(a, b, c, 0, a.rows(), 0, b.cols());
+}
+
+// floating point throughput of a size x size x size multiplication
+static inline double gemm_gflops(int size, double seconds) {
+    return 2.0 * size * size * (double)size / seconds / 1e9;
+}
+
+#endif
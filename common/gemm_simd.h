@@ -0,0 +1,209 @@
+#ifndef GEMM_SIMD_H
+#define GEMM_SIMD_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// the vector kernels are written for the 4x16 register block in gemm.h
+#if GEMM_MR != 4 || GEMM_NR != 16
+#error "gemm_simd.h kernels require GEMM_MR == 4 and GEMM_NR == 16"
+#endif
+
+#if defined(__x86_64__) || defined(__i386__)
+#define GEMM_X86 1
+#include <immintrin.h>
+#endif
+
+// instruction set levels for the int32 micro-kernels
+#define GEMM_ISA_SCALAR 0
+#define GEMM_ISA_AVX2 1
+#define GEMM_ISA_AVX512 2
+
+static inline const char* gemm_isa_name(int isa) {
+
+    switch (isa) {
+        case GEMM_ISA_AVX512: return "avx512";
+        case GEMM_ISA_AVX2: return "avx2";
+        default: return "scalar";
+    }
+}
+
+// best isa supported by this cpu, GEMM_ISA=scalar|avx2|avx512 caps it
+static inline int gemm_detect_isa() {
+
+    int isa = GEMM_ISA_SCALAR;
+
+#ifdef GEMM_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) isa = GEMM_ISA_AVX2;
+    if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw")) isa = GEMM_ISA_AVX512;
+#endif
+
+    const char* env = getenv("GEMM_ISA");
+    if (env) {
+        for (int cap = GEMM_ISA_SCALAR; cap <= GEMM_ISA_AVX512; cap++) {
+            if (strcmp(env, gemm_isa_name(cap)) == 0 && cap < isa) isa = cap;
+        }
+    }
+
+    return isa;
+}
+
+// cpuid is checked once during static initialisation, gemm_set_isa() can
+// lower the level (e.g. to compare kernels) but never raise it past the cpu
+inline const int gemm_cpu_isa = gemm_detect_isa();
+inline int gemm_active_isa = gemm_cpu_isa;
+
+// use int16 inputs with int32 accumulation when every input element fits
+inline bool gemm_narrow_enabled = true;
+
+static inline int gemm_isa() {
+    return gemm_active_isa;
+}
+
+static inline void gemm_set_isa(int isa, bool narrow) {
+    gemm_active_isa = isa < gemm_cpu_isa ? isa : gemm_cpu_isa;
+    gemm_narrow_enabled = narrow;
+}
+
+#ifdef GEMM_X86
+
+// add a GEMM_MR x GEMM_NR block of int32 accumulators to c, clipped to mr x nr
+static inline void gemm_store_i32(const int32_t* acc, int32_t* c, int ldc, int mr, int nr) {
+
+    for (int i = 0; i < mr; i++)
+    for (int j = 0; j < nr; j++)
+        c[(size_t)i * ldc + j] += acc[i * GEMM_NR + j];
+}
+
+// int32 4x16 micro-kernel, two ymm accumulators per row
+__attribute__((target("avx2")))
+static void gemm_kernel_i32_avx2(int kc, const int32_t* a, const int32_t* b, int32_t* c, int ldc, int mr, int nr) {
+
+    __m256i acc[GEMM_MR][2];
+    for (int i = 0; i < GEMM_MR; i++)
+        acc[i][0] = acc[i][1] = _mm256_setzero_si256();
+
+    for (int p = 0; p < kc; p++) {
+        __m256i b0 = _mm256_loadu_si256((const __m256i*)b);
+        __m256i b1 = _mm256_loadu_si256((const __m256i*)(b + 8));
+        for (int i = 0; i < GEMM_MR; i++) {
+            __m256i a_ip = _mm256_set1_epi32(a[i]);
+            acc[i][0] = _mm256_add_epi32(acc[i][0], _mm256_mullo_epi32(a_ip, b0));
+            acc[i][1] = _mm256_add_epi32(acc[i][1], _mm256_mullo_epi32(a_ip, b1));
+        }
+        a += GEMM_MR;
+        b += GEMM_NR;
+    }
+
+    if (mr == GEMM_MR && nr == GEMM_NR) {
+        for (int i = 0; i < GEMM_MR; i++) {
+            __m256i* row = (__m256i*)&c[(size_t)i * ldc];
+            _mm256_storeu_si256(row, _mm256_add_epi32(_mm256_loadu_si256(row), acc[i][0]));
+            _mm256_storeu_si256(row + 1, _mm256_add_epi32(_mm256_loadu_si256(row + 1), acc[i][1]));
+        }
+    }
+    else {
+        alignas(64) int32_t tmp[GEMM_MR * GEMM_NR];
+        for (int i = 0; i < GEMM_MR; i++) {
+            _mm256_store_si256((__m256i*)&tmp[i * GEMM_NR], acc[i][0]);
+            _mm256_store_si256((__m256i*)&tmp[i * GEMM_NR + 8], acc[i][1]);
+        }
+        gemm_store_i32(tmp, c, ldc, mr, nr);
+    }
+}
+
+// int32 4x16 micro-kernel, one zmm accumulator per row
+__attribute__((target("avx512f,avx512bw")))
+static void gemm_kernel_i32_avx512(int kc, const int32_t* a, const int32_t* b, int32_t* c, int ldc, int mr, int nr) {
+
+    __m512i acc[GEMM_MR];
+    for (int i = 0; i < GEMM_MR; i++)
+        acc[i] = _mm512_setzero_si512();
+
+    for (int p = 0; p < kc; p++) {
+        __m512i b0 = _mm512_loadu_si512(b);
+        for (int i = 0; i < GEMM_MR; i++)
+            acc[i] = _mm512_add_epi32(acc[i], _mm512_mullo_epi32(_mm512_set1_epi32(a[i]), b0));
+        a += GEMM_MR;
+        b += GEMM_NR;
+    }
+
+    if (mr == GEMM_MR) {
+        __mmask16 mask = (__mmask16)((1u << nr) - 1);
+        for (int i = 0; i < GEMM_MR; i++) {
+            int32_t* row = &c[(size_t)i * ldc];
+            _mm512_mask_storeu_epi32(row, mask, _mm512_add_epi32(_mm512_maskz_loadu_epi32(mask, row), acc[i]));
+        }
+    }
+    else {
+        alignas(64) int32_t tmp[GEMM_MR * GEMM_NR];
+        for (int i = 0; i < GEMM_MR; i++)
+            _mm512_store_si512(&tmp[i * GEMM_NR], acc[i]);
+        gemm_store_i32(tmp, c, ldc, mr, nr);
+    }
+}
+
+// int16 micro-kernels. k is packed in pairs so one madd multiplies two
+// consecutive k steps and sums them into int32 lanes:
+//  - a micro-panel holds (a[i][p], a[i][p+1]) int16 pairs, broadcast as one int32
+//  - b micro-panel holds (b[p][j], b[p+1][j]) int16 pairs for each column j
+// kc2 is the number of k pairs.
+__attribute__((target("avx2")))
+static void gemm_kernel_i16_avx2(int kc2, const int16_t* a, const int16_t* b, int32_t* c, int ldc, int mr, int nr) {
+
+    __m256i acc[GEMM_MR][2];
+    for (int i = 0; i < GEMM_MR; i++)
+        acc[i][0] = acc[i][1] = _mm256_setzero_si256();
+
+    for (int p = 0; p < kc2; p++) {
+        __m256i b0 = _mm256_loadu_si256((const __m256i*)b);
+        __m256i b1 = _mm256_loadu_si256((const __m256i*)(b + 16));
+        for (int i = 0; i < GEMM_MR; i++) {
+            int32_t pair;
+            memcpy(&pair, &a[i * 2], sizeof(pair));
+            __m256i a_ip = _mm256_set1_epi32(pair);
+            acc[i][0] = _mm256_add_epi32(acc[i][0], _mm256_madd_epi16(a_ip, b0));
+            acc[i][1] = _mm256_add_epi32(acc[i][1], _mm256_madd_epi16(a_ip, b1));
+        }
+        a += GEMM_MR * 2;
+        b += GEMM_NR * 2;
+    }
+
+    alignas(64) int32_t tmp[GEMM_MR * GEMM_NR];
+    for (int i = 0; i < GEMM_MR; i++) {
+        _mm256_store_si256((__m256i*)&tmp[i * GEMM_NR], acc[i][0]);
+        _mm256_store_si256((__m256i*)&tmp[i * GEMM_NR + 8], acc[i][1]);
+    }
+    gemm_store_i32(tmp, c, ldc, mr, nr);
+}
+
+__attribute__((target("avx512f,avx512bw")))
+static void gemm_kernel_i16_avx512(int kc2, const int16_t* a, const int16_t* b, int32_t* c, int ldc, int mr, int nr) {
+
+    __m512i acc[GEMM_MR];
+    for (int i = 0; i < GEMM_MR; i++)
+        acc[i] = _mm512_setzero_si512();
+
+    for (int p = 0; p < kc2; p++) {
+        __m512i b0 = _mm512_loadu_si512(b);
+        for (int i = 0; i < GEMM_MR; i++) {
+            int32_t pair;
+            memcpy(&pair, &a[i * 2], sizeof(pair));
+            acc[i] = _mm512_add_epi32(acc[i], _mm512_madd_epi16(_mm512_set1_epi32(pair), b0));
+        }
+        a += GEMM_MR * 2;
+        b += GEMM_NR * 2;
+    }
+
+    __mmask16 mask = (__mmask16)((1u << nr) - 1);
+    for (int i = 0; i < mr; i++) {
+        int32_t* row = &c[(size_t)i * ldc];
+        _mm512_mask_storeu_epi32(row, mask, _mm512_add_epi32(_mm512_maskz_loadu_epi32(mask, row), acc[i]));
+    }
+}
+
+#endif
+
+#endif
@@ -0,0 +1,298 @@
+#ifndef INTROSORT_H
+#define INTROSORT_H
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+// Introsort for int arrays.
+//
+// - pivots are the median of three, or above INTROSORT_NINTHER elements
+//   Tukey's ninther (median of three medians of three);
+// - partitioning is BlockQuicksort style: a block of INTROSORT_BLOCK elements
+//   from each end is scanned branchlessly into offset buffers of misplaced
+//   elements, which are then swapped pairwise;
+// - equal keys are split off three-way: when the pivot equals the element
+//   just before the range (which is <= everything in it), the pivot is the
+//   range minimum, so keys == pivot are partitioned to the left and dropped;
+// - recursion deeper than 2 log2(n) falls back to heapsort, and small ranges
+//   are finished by insertion sort.
+//
+// parallel_introsort() (openmp builds) also partitions the top levels with
+// every thread: each thread partitions a slice, then the misplaced elements
+// on either side of the global split point are swapped in parallel.
+
+#define INTROSORT_INSERTION 24
+#define INTROSORT_NINTHER 128
+#define INTROSORT_BLOCK 64
+
+// ranges at least this large are partitioned by all threads
+#define INTROSORT_PARALLEL_MIN (1 << 20)
+
+static inline long introsort_median3(const int* arr, long a, long b, long c) {
+
+    if (arr[a] < arr[b]) {
+        if (arr[b] < arr[c]) return b;
+        return arr[a] < arr[c] ? c : a;
+    }
+    if (arr[a] < arr[c]) return a;
+    return arr[b] < arr[c] ? c : b;
+}
+
+// index of the pivot for arr[low, high]
+static inline long introsort_pivot(const int* arr, long low, long high) {
+
+    long n = high - low + 1;
+    long mid = low + n / 2;
+    if (n < INTROSORT_NINTHER) return introsort_median3(arr, low, mid, high);
+
+    long s = n / 8;
+    long a = introsort_median3(arr, low, low + s, low + 2 * s);
+    long b = introsort_median3(arr, mid - s, mid, mid + s);
+    long c = introsort_median3(arr, high - 2 * s, high - s, high);
+    return introsort_median3(arr, a, b, c);
+}
+
+// partition arr[begin, end) around the value p and return m such that
+// arr[begin, m) < p and arr[m, end) >= p, or <= p and > p when equal is set
+template <bool equal>
+static inline long introsort_partition(int* arr, long begin, long end, int p) {
+
+    const int block = INTROSORT_BLOCK;
+    unsigned char left_offsets[INTROSORT_BLOCK], right_offsets[INTROSORT_BLOCK];
+    int left_count = 0, right_count = 0, left_start = 0, right_start = 0;
+    int* l = arr + begin;
+    int* r = arr + end;
+
+    // [l, r) is unknown, the blocks [l, l + block) and [r - block, r) are being worked on
+    while (r - l > 2 * block) {
+        if (left_count == 0) {
+            left_start = 0;
+            for (int i = 0; i < block; i++) {
+                left_offsets[left_count] = i;
+                left_count += equal ? l[i] > p : l[i] >= p;
+            }
+        }
+        if (right_count == 0) {
+            right_start = 0;
+            for (int i = 0; i < block; i++) {
+                right_offsets[right_count] = i;
+                right_count += equal ? r[-1 - i] <= p : r[-1 - i] < p;
+            }
+        }
+
+        int swaps = std::min(left_count, right_count);
+        for (int i = 0; i < swaps; i++)
+            std::swap(l[left_offsets[left_start + i]], r[-1 - right_offsets[right_start + i]]);
+
+        left_count -= swaps;
+        right_count -= swaps;
+        left_start += swaps;
+        right_start += swaps;
+        if (left_count == 0) l += block;
+        if (right_count == 0) r -= block;
+    }
+
+    // the rest, including a block with swaps still pending, by a branchless lomuto pass
+    int* store = l;
+    for (int* it = l; it < r; it++) {
+        int v = *it;
+        bool goes_left = equal ? v <= p : v < p;
+        *it = *store;
+        *store = v;
+        store += goes_left;
+    }
+
+    return store - arr;
+}
+
+static inline void introsort_insertion(int* arr, long low, long high) {
+
+    for (long i = low + 1; i <= high; i++) {
+        int v = arr[i];
+        long j = i - 1;
+        while (j >= low && arr[j] > v) {
+            arr[j + 1] = arr[j];
+            j--;
+        }
+        arr[j + 1] = v;
+    }
+}
+
+// sort arr[low, high]. unless leftmost, arr[low - 1] is <= every element of the range.
+static inline void introsort_loop(int* arr, long low, long high, int depth, bool leftmost) {
+
+    while (high - low + 1 > INTROSORT_INSERTION) {
+        if (depth-- == 0) {
+            std::make_heap(arr + low, arr + high + 1);
+            std::sort_heap(arr + low, arr + high + 1);
+            return;
+        }
+
+        std::swap(arr[low], arr[introsort_pivot(arr, low, high)]);
+        int p = arr[low];
+
+        // pivot equal to the predecessor is the range minimum, drop every key equal to it
+        if (!leftmost && arr[low - 1] == p) {
+            low = introsort_partition<true>(arr, low + 1, high + 1, p);
+            continue;
+        }
+
+        long m = introsort_partition<false>(arr, low + 1, high + 1, p);
+        std::swap(arr[low], arr[m - 1]);
+
+        // recurse into the smaller side and loop on the larger one
+        if (m - 1 - low < high - m + 1) {
+            introsort_loop(arr, low, m - 2, depth, leftmost);
+            low = m;
+            leftmost = false;
+        }
+        else {
+            introsort_loop(arr, m, high, depth, false);
+            high = m - 2;
+        }
+    }
+
+    introsort_insertion(arr, low, high);
+}
+
+static inline int introsort_depth(long n) {
+
+    int depth = 0;
+    while (n > 1) {
+        n >>= 1;
+        depth += 2;
+    }
+    return depth;
+}
+
+// sort arr[low, high] ascending
+static inline void introsort(int* arr, long low, long high) {
+
+    if (high > low) introsort_loop(arr, low, high, introsort_depth(high - low + 1), true);
+}
+
+#ifdef _OPENMP
+
+struct introsort_range {
+    long low, high;
+    int depth;
+    bool leftmost;
+};
+
+// introsort_partition of arr[low, high] with threads threads. each thread
+// partitions one slice, then the elements that belong right but sit left of
+// the global split point are swapped with those that belong left but sit
+// right of it, spread evenly over the threads.
+template <bool equal>
+static inline long introsort_parallel_partition(int* arr, long low, long high, int p, int threads) {
+
+    long n = high - low + 1;
+    std::vector<long> split(threads + 1), middle(threads);
+    for (int t = 0; t <= threads; t++) split[t] = low + n * t / threads;
+
+    #pragma omp parallel for num_threads(threads) schedule(static, 1)
+    for (int t = 0; t < threads; t++)
+        middle[t] = introsort_partition<equal>(arr, split[t], split[t + 1], p);
+
+    long mid = low;
+    for (int t = 0; t < threads; t++) mid += middle[t] - split[t];
+
+    // misplaced elements as [begin, end) runs, the two lists hold the same number
+    std::vector<std::pair<long, long>> right_runs, left_runs;
+    long misplaced = 0;
+    for (int t = 0; t < threads; t++) {
+        if (middle[t] < mid) {
+            std::pair<long, long> run(middle[t], std::min(split[t + 1], mid));
+            if (run.first < run.second) {
+                right_runs.push_back(run);
+                misplaced += run.second - run.first;
+            }
+        }
+        if (middle[t] > mid) {
+            std::pair<long, long> run(std::max(split[t], mid), middle[t]);
+            if (run.first < run.second) left_runs.push_back(run);
+        }
+    }
+
+    #pragma omp parallel for num_threads(threads) schedule(static, 1)
+    for (int t = 0; t < threads; t++) {
+        long first = misplaced * t / threads, count = misplaced * (t + 1) / threads - first;
+
+        // position k of a run list
+        auto seek = [](const std::vector<std::pair<long, long>> &runs, long k, size_t* run, long* pos) {
+            *run = 0;
+            while (k >= runs[*run].second - runs[*run].first) {
+                k -= runs[*run].second - runs[*run].first;
+                (*run)++;
+            }
+            *pos = runs[*run].first + k;
+        };
+
+        if (count > 0) {
+            size_t a_run, b_run;
+            long a, b;
+            seek(right_runs, first, &a_run, &a);
+            seek(left_runs, first, &b_run, &b);
+            for (long i = 0; i < count; i++) {
+                std::swap(arr[a], arr[b]);
+                if (++a == right_runs[a_run].second && a_run + 1 < right_runs.size()) a = right_runs[++a_run].first;
+                if (++b == left_runs[b_run].second && b_run + 1 < left_runs.size()) b = left_runs[++b_run].first;
+            }
+        }
+    }
+
+    return mid;
+}
+
+// sort arr[0, n) with threads threads. ranges larger than n / (4 threads) and
+// INTROSORT_PARALLEL_MIN are partitioned by all threads, breadth first, then
+// the remaining ranges are sorted one per thread, largest first.
+static inline void parallel_introsort(int* arr, long n, int threads) {
+
+    if (n < 2) return;
+
+    long parallel_min = std::max((long)INTROSORT_PARALLEL_MIN, n / (4L * threads));
+    std::vector<introsort_range> pending, ready;
+    pending.push_back({0, n - 1, introsort_depth(n), true});
+
+    while (!pending.empty()) {
+        introsort_range r = pending.back();
+        pending.pop_back();
+
+        if (threads < 2 || r.high - r.low + 1 < parallel_min || r.depth == 0) {
+            ready.push_back(r);
+            continue;
+        }
+
+        int p = arr[introsort_pivot(arr, r.low, r.high)];
+        bool equal = !r.leftmost && arr[r.low - 1] == p;
+        long mid = equal ? introsort_parallel_partition<true>(arr, r.low, r.high, p, threads)
+                         : introsort_parallel_partition<false>(arr, r.low, r.high, p, threads);
+
+        // nothing below the pivot: it is the minimum, so split off the keys equal to it instead
+        if (!equal && mid == r.low) {
+            mid = introsort_parallel_partition<true>(arr, r.low, r.high, p, threads);
+            equal = true;
+        }
+
+        // with equal, arr[low, mid) all equal p and are done
+        if (!equal && mid - 1 > r.low) pending.push_back({r.low, mid - 1, r.depth - 1, r.leftmost});
+        if (mid < r.high) pending.push_back({mid, r.high, r.depth - 1, false});
+    }
+
+    std::sort(ready.begin(), ready.end(), [](const introsort_range &a, const introsort_range &b) {
+        return a.high - a.low > b.high - b.low;
+    });
+
+    #pragma omp parallel for num_threads(threads) schedule(dynamic, 1)
+    for (size_t i = 0; i < ready.size(); i++)
+        introsort_loop(arr, ready[i].low, ready[i].high, ready[i].depth, ready[i].leftmost);
+}
+
+#endif
+
+#endif
@@ -0,0 +1,175 @@
+#ifndef KWAY_MERGE_H
+#define KWAY_MERGE_H
+
+#include <limits.h>
+#include <algorithm>
+#include <vector>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#ifdef __SSE2__
+#include <immintrin.h>
+#endif
+
+// Parallel k-way merge of sorted int runs.
+//
+// The output is cut into one equal range per thread. Merge-path co-ranking
+// finds, for an output position, how many keys of each run come before it
+// (a binary search on the key value, with ties taken from lower runs first,
+// so adjacent threads agree on every cut). Each thread then merges its slice
+// of every run with a loser tree: the root holds the run with the smallest
+// head, and after taking it only the path from that run's leaf is replayed,
+// log2(k) comparisons per key. Output goes out with non-temporal stores
+// where SSE2 has them, since the merged array is not read again soon.
+
+// keys in run i that come before output position pos of the merge
+static inline void kway_corank(const int* data, const std::vector<long> &bounds, long pos, std::vector<long> &cuts) {
+
+    int k = bounds.size() - 1;
+    cuts.assign(k, 0);
+
+    long total = bounds[k] - bounds[0];
+    if (pos >= total) {
+        for (int r = 0; r < k; r++) cuts[r] = bounds[r + 1] - bounds[r];
+        return;
+    }
+
+    // smallest key v with more than pos keys <= v, that key is output pos
+    long low = INT_MIN, high = INT_MAX;
+    while (low < high) {
+        long v = low + (high - low) / 2;
+        long at_most = 0;
+        for (int r = 0; r < k; r++)
+            at_most += std::upper_bound(data + bounds[r], data + bounds[r + 1], (int)v) - (data + bounds[r]);
+        if (at_most > pos) high = v;
+        else low = v + 1;
+    }
+
+    // every key below v, then keys equal to v from the lowest runs on
+    long remaining = pos;
+    for (int r = 0; r < k; r++) {
+        cuts[r] = std::lower_bound(data + bounds[r], data + bounds[r + 1], (int)low) - (data + bounds[r]);
+        remaining -= cuts[r];
+    }
+    for (int r = 0; r < k && remaining > 0; r++) {
+        long equal = std::upper_bound(data + bounds[r] + cuts[r], data + bounds[r + 1], (int)low) - (data + bounds[r] + cuts[r]);
+        long take = std::min(equal, remaining);
+        cuts[r] += take;
+        remaining -= take;
+    }
+}
+
+static inline void kway_store(int* out, int v) {
+#ifdef __SSE2__
+    _mm_stream_si32(out, v);
+#else
+    *out = v;
+#endif
+}
+
+struct kway_loser_tree {
+    int leaves;                 // a power of two, runs past k are empty
+    std::vector<int> node;      // node[0] the winner, node[1, leaves) the losers
+    std::vector<const int*> head, end;
+
+    // run a before run b: exhausted runs last, ties to the lower run
+    bool before(int a, int b) const {
+        if (head[a] == end[a]) return false;
+        if (head[b] == end[b]) return true;
+        if (*head[a] != *head[b]) return *head[a] < *head[b];
+        return a < b;
+    }
+
+    void build() {
+        std::vector<int> winner(2 * leaves);
+        for (int i = 0; i < leaves; i++) winner[leaves + i] = i;
+        for (int i = leaves - 1; i > 0; i--) {
+            int a = winner[2 * i], b = winner[2 * i + 1];
+            winner[i] = before(a, b) ? a : b;
+            node[i] = before(a, b) ? b : a;
+        }
+        node[0] = winner[1];
+    }
+
+    // the winner's head moved, play it back up to the root
+    void replay() {
+        int w = node[0];
+        for (int i = (leaves + w) / 2; i > 0; i /= 2) {
+            if (before(node[i], w)) std::swap(node[i], w);
+        }
+        node[0] = w;
+    }
+};
+
+// merge the sorted runs [first[r], last[r]) into out, count keys in total
+static inline void kway_merge_runs(const std::vector<const int*> &first, const std::vector<const int*> &last,
+                                   int* out, long count) {
+
+    int k = first.size();
+    if (k == 1) {
+        for (long i = 0; i < count; i++) kway_store(out + i, first[0][i]);
+        return;
+    }
+
+    kway_loser_tree tree;
+    tree.leaves = 1;
+    while (tree.leaves < k) tree.leaves <<= 1;
+    tree.node.resize(tree.leaves);
+    tree.head.assign(tree.leaves, NULL);
+    tree.end.assign(tree.leaves, NULL);
+    for (int r = 0; r < k; r++) {
+        tree.head[r] = first[r];
+        tree.end[r] = last[r];
+    }
+    tree.build();
+
+    for (long i = 0; i < count; i++) {
+        int w = tree.node[0];
+        kway_store(out + i, *tree.head[w]++);
+        tree.replay();
+    }
+}
+
+// merge the sorted runs data[bounds[r], bounds[r + 1]) into out with threads threads
+static inline void kway_merge(const int* data, const std::vector<long> &bounds, int* out, int threads) {
+
+    int k = bounds.size() - 1;
+    long total = k > 0 ? bounds[k] - bounds[0] : 0;
+    if (total == 0) return;
+    if (threads < 1) threads = 1;
+    if (total < 4096L * threads) threads = 1;
+
+#ifdef _OPENMP
+    #pragma omp parallel for num_threads(threads) schedule(static, 1)
+#endif
+    for (int t = 0; t < threads; t++) {
+        long start = total * t / threads, stop = total * (t + 1) / threads;
+
+        std::vector<long> from, to;
+        kway_corank(data, bounds, start, from);
+        kway_corank(data, bounds, stop, to);
+
+        std::vector<const int*> first(k), last(k);
+        for (int r = 0; r < k; r++) {
+            first[r] = data + bounds[r] + from[r];
+            last[r] = data + bounds[r] + to[r];
+        }
+        kway_merge_runs(first, last, out + start, stop - start);
+
+        // order the non-temporal stores before anyone reads the output
+#ifdef __SSE2__
+        _mm_sfence();
+#endif
+    }
+}
+
+// threads for kway_merge, the openmp default when built with it
+static inline int kway_merge_threads() {
+#ifdef _OPENMP
+    return omp_get_max_threads();
+#else
+    return 1;
+#endif
+}
+
+#endif
@@ -0,0 +1,123 @@
+#ifndef MATRIX_H
+#define MATRIX_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <new>
+
+// element type used by the matmul programs, select at compile time with
+// -DMATRIX_ELEM=int32_t|int64_t|float|double
+#ifndef MATRIX_ELEM
+#define MATRIX_ELEM int32_t
+#endif
+
+typedef MATRIX_ELEM elem_t;
+
+// alignment of the matrix allocation (one cache line, also a full avx-512 vector)
+#define MATRIX_ALIGN 64
+
+// name of an element type, matches the opencl c type of the same width
+template <class T> inline const char* matrix_type_name();
+template <> inline const char* matrix_type_name<int32_t>() { return "int"; }
+template <> inline const char* matrix_type_name<int64_t>() { return "long"; }
+template <> inline const char* matrix_type_name<float>() { return "float"; }
+template <> inline const char* matrix_type_name<double>() { return "double"; }
+
+// dense row-major matrix in a single aligned allocation.
+// rows are addressed as m[r][c] without a row pointer table, and ownership
+// can only be moved so large matrices are never copied by accident.
+template <class T>
+class Matrix {
+public:
+    Matrix():
+        _data(NULL),
+        _rows(0),
+        _cols(0)
+    {}
+
+    // contents are left uninitialised so the first touch can happen on the
+    // thread that will use the memory, call fill() to initialise
+    Matrix(int rows, int cols):
+        _data(NULL),
+        _rows(rows),
+        _cols(cols)
+    {
+        size_t bytes = (count() * sizeof(T) + MATRIX_ALIGN - 1) & ~(size_t)(MATRIX_ALIGN - 1);
+        if (bytes > 0) {
+            _data = (T*)aligned_alloc(MATRIX_ALIGN, bytes);
+            if (_data == NULL) throw std::bad_alloc();
+        }
+    }
+
+    ~Matrix()
+    {
+        free(_data);
+    }
+
+    Matrix(const Matrix&) = delete;
+    Matrix& operator=(const Matrix&) = delete;
+
+    Matrix(Matrix&& other) noexcept:
+        _data(other._data),
+        _rows(other._rows),
+        _cols(other._cols)
+    {
+        other._data = NULL;
+        other._rows = 0;
+        other._cols = 0;
+    }
+
+    Matrix& operator=(Matrix&& other) noexcept {
+
+        if (this != &other) {
+            free(_data);
+            _data = other._data;
+            _rows = other._rows;
+            _cols = other._cols;
+            other._data = NULL;
+            other._rows = 0;
+            other._cols = 0;
+        }
+        return *this;
+    }
+
+    // row views
+    T* operator[](int row) { return _data + (size_t)row * _cols; }
+    const T* operator[](int row) const { return _data + (size_t)row * _cols; }
+
+    T* data() { return _data; }
+    const T* data() const { return _data; }
+
+    int rows() const { return _rows; }
+    int cols() const { return _cols; }
+
+    // distance in elements between the start of consecutive rows
+    int stride() const { return _cols; }
+
+    size_t count() const { return (size_t)_rows * _cols; }
+    size_t bytes() const { return count() * sizeof(T); }
+
+    void fill(T value) {
+
+        if (value == T(0)) {
+            if (_data) memset(_data, 0, bytes());
+        }
+        else {
+            for (size_t i = 0; i < count(); i++) _data[i] = value;
+        }
+    }
+
+    bool operator==(const Matrix& other) const {
+
+        return _rows == other._rows && _cols == other._cols &&
+            (count() == 0 || memcmp(_data, other._data, bytes()) == 0);
+    }
+
+private:
+    T* _data;
+    int _rows;
+    int _cols;
+};
+
+#endif
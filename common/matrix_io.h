@@ -0,0 +1,265 @@
+#ifndef MATRIX_IO_H
+#define MATRIX_IO_H
+
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "matrix.h"
+
+// Binary matrix files (.mat) are a sequence of records, each a 128 byte
+// header followed by rows * cols elements in row-major order. Data is
+// written with a few large write() calls straight from the matrix storage,
+// and read back by mmap()ing the whole file. tools/mm-convert turns a .mat
+// file back into the csv text the programs used to write.
+//
+// matrix_block_checksum() is separate from the record checksum: it can be
+// computed piecewise on distributed blocks and summed.
+
+#define MATRIX_FILE_MAGIC "SITMAT01"
+#define MATRIX_FILE_TITLE 80
+
+// largest single write() call
+#define MATRIX_FILE_CHUNK (64u << 20)
+
+#define MATRIX_DTYPE_INT32 1
+#define MATRIX_DTYPE_INT64 2
+#define MATRIX_DTYPE_FLOAT32 3
+#define MATRIX_DTYPE_FLOAT64 4
+
+struct matrix_file_header {
+    char magic[8];                      // MATRIX_FILE_MAGIC
+    uint32_t dtype;                     // MATRIX_DTYPE_*
+    uint32_t elem_size;                 // bytes per element
+    uint64_t rows;
+    uint64_t cols;
+    uint64_t checksum;                  // matrix_checksum() of the data
+    uint64_t reserved;
+    char title[MATRIX_FILE_TITLE];      // nul terminated
+};
+
+static_assert(sizeof(matrix_file_header) == 128, "matrix file header must be 128 bytes");
+
+template <class T> inline uint32_t matrix_dtype();
+template <> inline uint32_t matrix_dtype<int32_t>() { return MATRIX_DTYPE_INT32; }
+template <> inline uint32_t matrix_dtype<int64_t>() { return MATRIX_DTYPE_INT64; }
+template <> inline uint32_t matrix_dtype<float>() { return MATRIX_DTYPE_FLOAT32; }
+template <> inline uint32_t matrix_dtype<double>() { return MATRIX_DTYPE_FLOAT64; }
+
+static inline const char* matrix_dtype_name(uint32_t dtype) {
+
+    switch (dtype) {
+        case MATRIX_DTYPE_INT32: return "int32";
+        case MATRIX_DTYPE_INT64: return "int64";
+        case MATRIX_DTYPE_FLOAT32: return "float32";
+        case MATRIX_DTYPE_FLOAT64: return "float64";
+        default: return "unknown";
+    }
+}
+
+// bytes per element of a dtype, 0 if unknown
+static inline uint32_t matrix_dtype_size(uint32_t dtype) {
+
+    switch (dtype) {
+        case MATRIX_DTYPE_INT32: return 4;
+        case MATRIX_DTYPE_INT64: return 8;
+        case MATRIX_DTYPE_FLOAT32: return 4;
+        case MATRIX_DTYPE_FLOAT64: return 8;
+        default: return 0;
+    }
+}
+
+// fnv-1a over 64-bit words (tail bytes zero padded), one multiply per 8 bytes
+static inline uint64_t matrix_checksum(const void* data, size_t bytes) {
+
+    const unsigned char* p = (const unsigned char*)data;
+    uint64_t h = 0xcbf29ce484222325ull;
+
+    size_t words = bytes / 8;
+    for (size_t i = 0; i < words; i++) {
+        uint64_t w;
+        memcpy(&w, p + i * 8, 8);
+        h = (h ^ w) * 0x100000001b3ull;
+    }
+
+    if (bytes % 8) {
+        uint64_t w = 0;
+        memcpy(&w, p + words * 8, bytes % 8);
+        h = (h ^ w) * 0x100000001b3ull;
+    }
+
+    return h;
+}
+
+// murmur3 64-bit finaliser
+static inline uint64_t matrix_checksum_mix(uint64_t z) {
+
+    z = (z ^ (z >> 33)) * 0xff51afd7ed558ccdull;
+    z = (z ^ (z >> 33)) * 0xc4ceb9fe1a85ec53ull;
+    return z ^ (z >> 33);
+}
+
+// checksum of the block of a matrix with total_cols columns whose element
+// (0, 0) is (first_row, first_col), held locally as m. a wrapping sum of one
+// hash per (position, value), so partial sums over any split of the matrix
+// (e.g. MPI_SUM on MPI_UINT64_T) add up to the whole matrix's checksum.
+template <class T>
+static inline uint64_t matrix_block_checksum(const Matrix<T> &m, int first_row, int first_col, int total_cols) {
+
+    uint64_t sum = 0;
+    int cols = m.cols();
+
+#ifdef _OPENMP
+    #pragma omp parallel for reduction(+:sum) schedule(static)
+#endif
+    for (int r = 0; r < m.rows(); r++) {
+        const T* row = m[r];
+        uint64_t pos = (uint64_t)(first_row + r) * total_cols + first_col;
+        for (int c = 0; c < cols; c++) {
+            uint64_t bits = 0;
+            memcpy(&bits, &row[c], sizeof(T));
+            sum += matrix_checksum_mix(bits ^ matrix_checksum_mix(pos + c));
+        }
+    }
+    return sum;
+}
+
+// as matrix_block_checksum for full-width rows starting at first_row
+template <class T>
+static inline uint64_t matrix_sum_checksum(const Matrix<T> &m, int first_row) {
+    return matrix_block_checksum(m, first_row, 0, m.cols());
+}
+
+// write all bytes, retrying partial writes, in chunks of at most MATRIX_FILE_CHUNK
+static inline bool matrix_write_all(int fd, const void* data, size_t bytes) {
+
+    const char* p = (const char*)data;
+    while (bytes > 0) {
+        size_t chunk = bytes < MATRIX_FILE_CHUNK ? bytes : MATRIX_FILE_CHUNK;
+        ssize_t written = write(fd, p, chunk);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        p += written;
+        bytes -= written;
+    }
+    return true;
+}
+
+// append a matrix record to an open file descriptor
+template <class T>
+static inline bool write_matrix(int fd, const Matrix<T> &matrix, const char* title) {
+
+    if (fd < 0) return false;
+
+    matrix_file_header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, MATRIX_FILE_MAGIC, sizeof(header.magic));
+    header.dtype = matrix_dtype<T>();
+    header.elem_size = sizeof(T);
+    header.rows = matrix.rows();
+    header.cols = matrix.cols();
+    header.checksum = matrix_checksum(matrix.data(), matrix.bytes());
+    strncpy(header.title, title, MATRIX_FILE_TITLE - 1);
+
+    return matrix_write_all(fd, &header, sizeof(header)) &&
+           matrix_write_all(fd, matrix.data(), matrix.bytes());
+}
+
+static inline int open_matrix_file(const char* filename) {
+    return open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+}
+
+// read-only mapping of a whole .mat file
+struct matrix_file {
+    const char* base;
+    size_t size;
+};
+
+static inline bool map_matrix_file(const char* filename, matrix_file* file) {
+
+    file->base = NULL;
+    file->size = 0;
+
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat st;
+    if (fstat(fd, &st) < 0 || st.st_size == 0) {
+        close(fd);
+        return false;
+    }
+
+    void* base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) return false;
+
+    madvise(base, st.st_size, MADV_SEQUENTIAL);
+    file->base = (const char*)base;
+    file->size = st.st_size;
+    return true;
+}
+
+static inline void unmap_matrix_file(matrix_file* file) {
+
+    if (file->base) munmap((void*)file->base, file->size);
+    file->base = NULL;
+    file->size = 0;
+}
+
+// true if the file starts with a matrix record header
+static inline bool is_matrix_file(const matrix_file &file) {
+    return file.size >= sizeof(matrix_file_header) && memcmp(file.base, MATRIX_FILE_MAGIC, 8) == 0;
+}
+
+// record at *offset, advancing *offset past it. returns NULL at the end of
+// the file or if the record is truncated or corrupt. the header is checked
+// before anything is multiplied: the element size must match a known dtype
+// (unknown dtypes are passed through for the caller to skip), rows and cols
+// must fit the int dimensions of Matrix and the data must fit in the rest of
+// the file, and the title must be nul terminated.
+static inline const matrix_file_header* next_matrix_record(const matrix_file &file, size_t* offset, const void** data) {
+
+    if (*offset > file.size || file.size - *offset < sizeof(matrix_file_header)) return NULL;
+
+    const matrix_file_header* header = (const matrix_file_header*)(file.base + *offset);
+    if (memcmp(header->magic, MATRIX_FILE_MAGIC, 8) != 0) return NULL;
+    if (header->title[MATRIX_FILE_TITLE - 1] != '\0') return NULL;
+
+    uint32_t dtype_size = matrix_dtype_size(header->dtype);
+    if (header->elem_size == 0 || (dtype_size != 0 && header->elem_size != dtype_size)) return NULL;
+    if (header->rows > INT_MAX || header->cols > INT_MAX) return NULL;
+
+    // rows * cols * elem_size <= available, without overflowing
+    uint64_t max_elems = (file.size - *offset - sizeof(matrix_file_header)) / header->elem_size;
+    if (header->rows != 0 && header->cols > max_elems / header->rows) return NULL;
+
+    size_t bytes = header->rows * header->cols * header->elem_size;
+
+    *data = file.base + *offset + sizeof(matrix_file_header);
+    *offset += sizeof(matrix_file_header) + bytes;
+    return header;
+}
+
+static inline bool matrix_record_valid(const matrix_file_header* header, const void* data) {
+    return matrix_checksum(data, header->rows * header->cols * header->elem_size) == header->checksum;
+}
+
+// copy a record into a matrix of the same element type
+template <class T>
+static inline bool read_matrix_record(const matrix_file_header* header, const void* data, Matrix<T> &matrix) {
+
+    if (header->dtype != matrix_dtype<T>() || header->elem_size != sizeof(T)) return false;
+
+    matrix = Matrix<T>(header->rows, header->cols);
+    if (matrix.bytes() > 0) memcpy(matrix.data(), data, matrix.bytes());
+    return true;
+}
+
+#endif
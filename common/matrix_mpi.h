@@ -0,0 +1,17 @@
+#ifndef MATRIX_MPI_H
+#define MATRIX_MPI_H
+
+#include <mpi.h>
+#include "matrix.h"
+
+// mpi datatype matching a matrix element type
+template <class T> inline MPI_Datatype matrix_mpi_type();
+template <> inline MPI_Datatype matrix_mpi_type<int32_t>() { return MPI_INT32_T; }
+template <> inline MPI_Datatype matrix_mpi_type<int64_t>() { return MPI_INT64_T; }
+template <> inline MPI_Datatype matrix_mpi_type<float>() { return MPI_FLOAT; }
+template <> inline MPI_Datatype matrix_mpi_type<double>() { return MPI_DOUBLE; }
+
+// datatype of elem_t, use in place of MPI_INT when sending matrix data
+#define MPI_ELEM matrix_mpi_type<elem_t>()
+
+#endif
@@ -0,0 +1,88 @@
+#ifndef MATRIX_RAND_H
+#define MATRIX_RAND_H
+
+#include <stdint.h>
+#include <time.h>
+#include "matrix.h"
+
+// Counter-based random matrices. Element (row, col) of a stream is a pure
+// function of (seed, stream, row, col): there is no generator state, so rows
+// can be produced in any order, by any number of threads or MPI ranks, and
+// the matrix is bit-identical every time. Each value is one splitmix64 step
+// taken at position (row << 32 | col) of a sequence keyed by seed and stream.
+
+// independent streams for the two inputs of a product
+#define MATRIX_STREAM_A 0
+#define MATRIX_STREAM_B 1
+
+#define MATRIX_RAND_GOLDEN 0x9e3779b97f4a7c15ull
+
+// splitmix64 output function
+static inline uint64_t matrix_rand_mix(uint64_t z) {
+
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+}
+
+static inline uint64_t matrix_rand_key(uint64_t seed, uint32_t stream) {
+    return matrix_rand_mix(seed ^ matrix_rand_mix((uint64_t)stream + MATRIX_RAND_GOLDEN));
+}
+
+// uniform in [0, max) for element (row, col) of the stream with this key
+static inline uint32_t matrix_rand_at(uint64_t key, uint32_t row, uint32_t col, uint32_t max) {
+
+    uint64_t bits = matrix_rand_mix(key + (((uint64_t)row << 32) | col) * MATRIX_RAND_GOLDEN);
+    return (uint32_t)(((bits >> 32) * max) >> 32);
+}
+
+// fill local rows [row_start, row_end), columns [col_start, col_end) of m, whose
+// element (0, 0) is element (first_row, first_col) of the full matrix, with values in [0, max)
+template <class T>
+static inline void matrix_rand_tile(Matrix<T> &m, uint64_t seed, uint32_t stream, int first_row, int first_col,
+                                    int row_start, int row_end, int col_start, int col_end, uint32_t max) {
+
+    uint64_t key = matrix_rand_key(seed, stream);
+
+    for (int r = row_start; r < row_end; r++) {
+        T* row = m[r];
+        uint32_t global_row = first_row + r;
+        for (int c = col_start; c < col_end; c++)
+            row[c] = (T)matrix_rand_at(key, global_row, first_col + c, max);
+    }
+}
+
+// fill local rows [row_start, row_end) of m
+template <class T>
+static inline void matrix_rand_rows(Matrix<T> &m, uint64_t seed, uint32_t stream, int first_row, int first_col,
+                                    int row_start, int row_end, uint32_t max) {
+    matrix_rand_tile(m, seed, stream, first_row, first_col, row_start, row_end, 0, m.cols(), max);
+}
+
+// fill all of m with the block at (first_row, first_col), rows split across
+// omp threads when built with openmp
+template <class T>
+static inline void matrix_rand_block(Matrix<T> &m, uint64_t seed, uint32_t stream, int first_row, int first_col, uint32_t max) {
+
+#ifdef _OPENMP
+    #pragma omp parallel for schedule(static)
+#endif
+    for (int r = 0; r < m.rows(); r++)
+        matrix_rand_rows(m, seed, stream, first_row, first_col, r, r + 1, max);
+}
+
+// fill all of m with full-width rows starting at first_row
+template <class T>
+static inline void matrix_rand_fill(Matrix<T> &m, uint64_t seed, uint32_t stream, int first_row, uint32_t max) {
+    matrix_rand_block(m, seed, stream, first_row, 0, max);
+}
+
+// default seed when none is given on the command line
+static inline uint64_t matrix_rand_seed() {
+
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return matrix_rand_mix((uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec);
+}
+
+#endif
@@ -0,0 +1,161 @@
+#ifndef PLACEMENT_H
+#define PLACEMENT_H
+
+#include <mpi.h>
+#include <omp.h>
+#include <pthread.h>
+#include <sched.h>
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+// Thread placement for hybrid mpi + openmp ranks (linux). the ranks sharing a
+// node (MPI_Comm_split_type with MPI_COMM_TYPE_SHARED) split the node's cpus
+// between them, grouped by numa node, and each rank runs one omp thread per
+// cpu in its share, pinned to that cpu. if the launcher has already bound the
+// rank to a subset of the cpus, that subset is used as is.
+
+struct node_placement {
+    int node_rank;                  // this rank among the ranks on its node
+    int node_size;                  // ranks on this node
+    std::vector<int> cpus;          // cpus the omp threads are pinned to, one thread each
+    std::vector<int> numa_nodes;    // numa nodes of those cpus
+    bool bound_by_launcher;         // affinity was already restricted at startup
+};
+
+// numa node of a cpu from sysfs, 0 if the kernel does not expose one
+static inline int placement_numa_node(int cpu) {
+
+    char path[64];
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d", cpu);
+
+    DIR* dir = opendir(path);
+    if (dir == NULL) return 0;
+
+    int node = 0;
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (strncmp(entry->d_name, "node", 4) == 0 && entry->d_name[4] >= '0' && entry->d_name[4] <= '9') {
+            node = atoi(entry->d_name + 4);
+            break;
+        }
+    }
+    closedir(dir);
+    return node;
+}
+
+// cpus this process may run on
+static inline std::vector<int> placement_allowed_cpus() {
+
+    std::vector<int> cpus;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+
+    if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+        for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+            if (CPU_ISSET(cpu, &set)) cpus.push_back(cpu);
+    }
+    if (cpus.empty()) cpus.push_back(0);
+    return cpus;
+}
+
+// this rank's share of its node's cpus, collective over comm
+static inline node_placement placement_create(MPI_Comm comm) {
+
+    node_placement placement;
+
+    MPI_Comm node_comm;
+    MPI_Comm_split_type(comm, MPI_COMM_TYPE_SHARED, 0, MPI_INFO_NULL, &node_comm);
+    MPI_Comm_rank(node_comm, &placement.node_rank);
+    MPI_Comm_size(node_comm, &placement.node_size);
+    MPI_Comm_free(&node_comm);
+
+    std::vector<int> allowed = placement_allowed_cpus();
+    long online = sysconf(_SC_NPROCESSORS_ONLN);
+    placement.bound_by_launcher = online > 0 && (long)allowed.size() < online;
+
+    if (placement.bound_by_launcher) {
+        placement.cpus = allowed;
+    }
+    else {
+        // order by (numa node, cpu) so each contiguous share stays on as few nodes as possible
+        std::vector<std::pair<int, int>> order;
+        for (size_t i = 0; i < allowed.size(); i++)
+            order.push_back(std::make_pair(placement_numa_node(allowed[i]), allowed[i]));
+        std::sort(order.begin(), order.end());
+
+        int n = order.size(), ranks = placement.node_size, r = placement.node_rank;
+        if (ranks >= n) {
+            // more ranks than cpus, ranks share cpus round robin
+            placement.cpus.push_back(order[r % n].second);
+        }
+        else {
+            for (int i = r * n / ranks; i < (r + 1) * n / ranks; i++)
+                placement.cpus.push_back(order[i].second);
+        }
+    }
+
+    for (size_t i = 0; i < placement.cpus.size(); i++) {
+        int node = placement_numa_node(placement.cpus[i]);
+        if (std::find(placement.numa_nodes.begin(), placement.numa_nodes.end(), node) == placement.numa_nodes.end())
+            placement.numa_nodes.push_back(node);
+    }
+
+    return placement;
+}
+
+static inline int placement_threads(const node_placement &placement) {
+    return placement.cpus.size();
+}
+
+// pin omp thread i to cpus[i] and make that team size the default. libgomp
+// keeps its worker threads between parallel regions, so the pinning holds for
+// every later region of the same size or smaller.
+static inline void placement_pin_threads(const node_placement &placement) {
+
+    int threads = placement_threads(placement);
+    omp_set_num_threads(threads);
+
+    #pragma omp parallel num_threads(threads)
+    {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(placement.cpus[omp_get_thread_num() % threads], &set);
+        pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    }
+}
+
+// compress a sorted list of ints into ranges, e.g. "0-3,8"
+static inline std::string placement_ranges(std::vector<int> values) {
+
+    std::sort(values.begin(), values.end());
+    std::string out;
+    char buf[32];
+
+    for (size_t i = 0; i < values.size(); ) {
+        size_t j = i;
+        while (j + 1 < values.size() && values[j + 1] == values[j] + 1) j++;
+        if (j == i) snprintf(buf, sizeof(buf), "%s%d", out.empty() ? "" : ",", values[i]);
+        else snprintf(buf, sizeof(buf), "%s%d-%d", out.empty() ? "" : ",", values[i], values[j]);
+        out += buf;
+        i = j + 1;
+    }
+    return out;
+}
+
+static inline std::string placement_describe(const node_placement &placement) {
+
+    char buf[128];
+    snprintf(buf, sizeof(buf), "node rank %d/%d, %d threads on cpus %s, numa %s%s",
+             placement.node_rank, placement.node_size, placement_threads(placement),
+             placement_ranges(placement.cpus).c_str(), placement_ranges(placement.numa_nodes).c_str(),
+             placement.bound_by_launcher ? " (launcher binding)" : "");
+    return buf;
+}
+
+#endif
@@ -0,0 +1,137 @@
+#ifndef RADIX_SORT_H
+#define RADIX_SORT_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+#include <omp.h>
+
+// Parallel LSD radix sort for int keys.
+//
+// Keys are sorted on their offset from the smallest key, so the pass count
+// follows the observed range: max - min needing b bits takes
+// ceil(b / RADIX_SORT_MAX_BITS) passes with the bits split evenly between them
+// (the Task2.2C keys, below 10M, take three 8-bit passes). Each pass:
+// - every thread counts digits over its own slice into a private histogram;
+// - an exclusive prefix sum over (digit, thread) gives each thread its own
+//   output offset per digit, which keeps the sort stable;
+// - every thread scatters its slice through write-combining buffers of one
+//   cache line per digit, so stores to the destination go out a full line
+//   at a time instead of one int to each of up to 2^bits open lines.
+// Passes ping-pong between data and one scratch array of n ints.
+
+#define RADIX_SORT_MAX_BITS 11
+
+// ints per write-combining buffer, one cache line
+#define RADIX_SORT_LINE 16
+
+static inline int radix_sort_bits(unsigned int range) {
+
+    int bits = 0;
+    while (bits < 32 && (range >> bits) != 0) bits++;
+    return bits;
+}
+
+// passes needed for keys whose range fits bits
+static inline int radix_sort_passes(int bits) {
+    return (bits + RADIX_SORT_MAX_BITS - 1) / RADIX_SORT_MAX_BITS;
+}
+
+// sort data[0, n) ascending with threads threads, returns the number of passes
+static inline int radix_sort(int* data, long n, int threads) {
+
+    if (n < 2) return 0;
+
+    int low = data[0], high = data[0];
+    #pragma omp parallel for num_threads(threads) reduction(min:low) reduction(max:high)
+    for (long i = 0; i < n; i++) {
+        low = std::min(low, data[i]);
+        high = std::max(high, data[i]);
+    }
+
+    int bits = radix_sort_bits((unsigned int)high - (unsigned int)low);
+    int passes = radix_sort_passes(bits);
+    if (passes == 0) return 0;
+
+    int digit_bits = (bits + passes - 1) / passes;
+    int bins = 1 << digit_bits;
+    unsigned int mask = bins - 1;
+
+    int* scratch = (int*)aligned_alloc(64, ((n * sizeof(int) + 63) / 64) * 64);
+    if (scratch == NULL) {
+        perror("Failed to allocate radix sort buffer. Exiting...\n");
+        exit(1);
+    }
+
+    // counts[t * bins + d], then turned into each thread's output offsets
+    std::vector<long> counts((size_t)threads * bins);
+    int* src = data;
+    int* dst = scratch;
+
+    for (int pass = 0; pass < passes; pass++) {
+        int shift = pass * digit_bits;
+
+        #pragma omp parallel num_threads(threads)
+        {
+            int t = omp_get_thread_num();
+            long first = n * t / threads, last = n * (t + 1) / threads;
+            long* count = &counts[(size_t)t * bins];
+
+            std::fill(count, count + bins, 0);
+            for (long i = first; i < last; i++)
+                count[(((unsigned int)src[i] - (unsigned int)low) >> shift) & mask]++;
+
+            #pragma omp barrier
+            #pragma omp single
+            {
+                long running = 0;
+                for (int d = 0; d < bins; d++)
+                for (int u = 0; u < threads; u++) {
+                    long c = counts[(size_t)u * bins + d];
+                    counts[(size_t)u * bins + d] = running;
+                    running += c;
+                }
+            }
+
+            int* lines = (int*)aligned_alloc(64, (size_t)bins * RADIX_SORT_LINE * sizeof(int));
+            std::vector<int> fill(bins, 0);
+            if (lines == NULL) {
+                perror("Failed to allocate radix sort buffer. Exiting...\n");
+                exit(1);
+            }
+
+            for (long i = first; i < last; i++) {
+                int v = src[i];
+                unsigned int d = (((unsigned int)v - (unsigned int)low) >> shift) & mask;
+                int* line = lines + (size_t)d * RADIX_SORT_LINE;
+                line[fill[d]++] = v;
+                if (fill[d] == RADIX_SORT_LINE) {
+                    memcpy(dst + count[d], line, RADIX_SORT_LINE * sizeof(int));
+                    count[d] += RADIX_SORT_LINE;
+                    fill[d] = 0;
+                }
+            }
+
+            for (int d = 0; d < bins; d++) {
+                memcpy(dst + count[d], lines + (size_t)d * RADIX_SORT_LINE, fill[d] * sizeof(int));
+                count[d] += fill[d];
+            }
+            free(lines);
+        }
+
+        std::swap(src, dst);
+    }
+
+    // an odd pass count leaves the result in scratch
+    if (src != data) {
+        #pragma omp parallel for num_threads(threads)
+        for (long i = 0; i < n; i++) data[i] = src[i];
+    }
+
+    free(scratch);
+    return passes;
+}
+
+#endif
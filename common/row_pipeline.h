@@ -0,0 +1,117 @@
+#ifndef ROW_PIPELINE_H
+#define ROW_PIPELINE_H
+
+#include <mpi.h>
+#include <vector>
+#include "matrix.h"
+#include "matrix_mpi.h"
+#include "summa.h"
+
+// Pipelined 1d row distribution. the root streams a to the other ranks in
+// chunks of rows with non-blocking point-to-point sends, every rank multiplies
+// each chunk as soon as it arrives and sends the finished rows of c straight
+// back, so distribution, compute and collection overlap instead of running
+// as three phases separated by barriers. rows are split over ranks as in
+// summa_block_start/summa_block_size. kernels have the summa_kernel_t signature.
+
+// default rows of a (and c) per message
+#define PIPELINE_CHUNK 128
+
+// seconds this rank spent in each phase
+struct pipeline_times {
+    double bcast;       // receiving b
+    double a_wait;      // blocked waiting for chunks of a
+    double compute;     // multiplying chunks
+    double c_wait;      // blocked completing c sends (root: c receives)
+};
+
+// c = a * b for size x size matrices. the root holds all of a and b and gets
+// all of c; other ranks pass empty matrices, which are sized here to hold
+// their rows. c is overwritten.
+template <class T>
+static inline void pipeline_multiply(MPI_Comm comm, int size, int chunk, Matrix<T> &a, Matrix<T> &b, Matrix<T> &c,
+                                     summa_kernel_t<T> kernel, void* ctx, pipeline_times* times) {
+
+    MPI_Datatype type = matrix_mpi_type<T>();
+    int rank, np;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &np);
+
+    int my_rows = summa_block_size(size, np, rank);
+    int my_chunks = (my_rows + chunk - 1) / chunk;
+
+    times->bcast = times->a_wait = times->compute = times->c_wait = 0;
+
+    if (rank != 0) {
+        a = Matrix<T>(my_rows, size);
+        b = Matrix<T>(size, size);
+        c = Matrix<T>(my_rows, size);
+    }
+    c.fill(0);
+
+    MPI_Request b_request;
+    MPI_Ibcast(b.data(), size * size, type, 0, comm, &b_request);
+
+    // rows [r0, r0 + rows) of my block, ranks' a and c chunks are tagged by index
+    std::vector<MPI_Request> a_requests, c_requests;
+
+    if (rank == 0) {
+        // chunk i of every rank goes out before chunk i + 1 of any rank, so all ranks start early
+        int max_chunks = (summa_block_size(size, np, 0) + chunk - 1) / chunk;
+        for (int i = 0; i < max_chunks; i++)
+        for (int p = 1; p < np; p++) {
+            int first = summa_block_start(size, np, p), rows = summa_block_size(size, np, p);
+            if (i * chunk >= rows) continue;
+            int n = gemm_min(chunk, rows - i * chunk);
+            MPI_Request request;
+            MPI_Isend(a[first + i * chunk], n * size, type, p, i, comm, &request);
+            a_requests.push_back(request);
+            MPI_Irecv(c[first + i * chunk], n * size, type, p, i, comm, &request);
+            c_requests.push_back(request);
+        }
+    }
+    else {
+        a_requests.resize(my_chunks);
+        for (int i = 0; i < my_chunks; i++) {
+            int n = gemm_min(chunk, my_rows - i * chunk);
+            MPI_Irecv(a[i * chunk], n * size, type, 0, i, comm, &a_requests[i]);
+        }
+    }
+
+    double t = MPI_Wtime();
+    MPI_Wait(&b_request, MPI_STATUS_IGNORE);
+    times->bcast = MPI_Wtime() - t;
+
+    for (int i = 0; i < my_chunks; i++) {
+        int r0 = i * chunk;
+        int n = gemm_min(chunk, my_rows - r0);
+
+        if (rank != 0) {
+            t = MPI_Wtime();
+            MPI_Wait(&a_requests[i], MPI_STATUS_IGNORE);
+            times->a_wait += MPI_Wtime() - t;
+        }
+
+        t = MPI_Wtime();
+        kernel(a[r0], a.stride(), b.data(), b.stride(), c[r0], c.stride(), n, size, size, ctx);
+        times->compute += MPI_Wtime() - t;
+
+        if (rank != 0) {
+            MPI_Request request;
+            MPI_Isend(c[r0], n * size, type, 0, i, comm, &request);
+            c_requests.push_back(request);
+        }
+        else if (!a_requests.empty()) {
+            // let outstanding sends progress between the root's own chunks
+            int done;
+            MPI_Testall(a_requests.size(), a_requests.data(), &done, MPI_STATUSES_IGNORE);
+        }
+    }
+
+    t = MPI_Wtime();
+    if (rank == 0) MPI_Waitall(a_requests.size(), a_requests.data(), MPI_STATUSES_IGNORE);
+    MPI_Waitall(c_requests.size(), c_requests.data(), MPI_STATUSES_IGNORE);
+    times->c_wait = MPI_Wtime() - t;
+}
+
+#endif
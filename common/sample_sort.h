@@ -0,0 +1,201 @@
+#ifndef SAMPLE_SORT_H
+#define SAMPLE_SORT_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <vector>
+#include <mpi.h>
+#include "kway_merge.h"
+#include "sort_verify.h"
+
+// Sample sort (parallel sorting by regular sampling) over any number of ranks.
+//
+// 1. every rank sorts its own block with the caller's sort;
+// 2. every rank takes np evenly spaced samples of its sorted block, all
+//    samples are gathered everywhere and sorted, and np - 1 splitters are
+//    taken from them at regular positions;
+// 3. each block is cut at the splitters and MPI_Alltoallv sends piece r to
+//    rank r, so rank r holds every key in (splitter r - 1, splitter r];
+// 4. every rank k-way merges the np sorted runs it received.
+//
+// The result stays distributed: concatenating the ranks' buckets in rank
+// order gives the sorted array. Regular sampling bounds every bucket by about
+// twice the average as long as keys are not heavily duplicated.
+
+struct sample_sort_times {
+    double local_sort;
+    double exchange;    // sampling, splitters and the all-to-all
+    double merge;
+};
+
+static inline double sample_sort_seconds(std::chrono::high_resolution_clock::time_point start) {
+    return std::chrono::duration_cast<std::chrono::duration<double>>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+// sort the distributed array whose local block is data[0, count), using
+// local_sort(data, low, high) for the local sorts. data is sorted in place as
+// a side effect. returns this rank's bucket (malloc'ed, *bucket_count keys).
+static inline int* sample_sort(int* data, int count, void (*local_sort)(int*, int, int), MPI_Comm comm,
+                               int* bucket_count, sample_sort_times* times) {
+
+    int np, rank;
+    MPI_Comm_size(comm, &np);
+    MPI_Comm_rank(comm, &rank);
+
+    std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+    if (count > 1) local_sort(data, 0, count - 1);
+    times->local_sort = sample_sort_seconds(start);
+
+    start = std::chrono::high_resolution_clock::now();
+
+    // np regular samples of the sorted block (fewer if the block is smaller)
+    int samples = std::min(count, np);
+    std::vector<int> sample(samples);
+    for (int i = 0; i < samples; i++) sample[i] = data[(long)i * count / samples];
+
+    std::vector<int> sample_counts(np), sample_displacements(np);
+    MPI_Allgather(&samples, 1, MPI_INT, sample_counts.data(), 1, MPI_INT, comm);
+    int total_samples = 0;
+    for (int r = 0; r < np; r++) {
+        sample_displacements[r] = total_samples;
+        total_samples += sample_counts[r];
+    }
+
+    std::vector<int> all_samples(std::max(total_samples, 1));
+    MPI_Allgatherv(sample.data(), samples, MPI_INT, all_samples.data(), sample_counts.data(),
+                   sample_displacements.data(), MPI_INT, comm);
+    std::sort(all_samples.begin(), all_samples.begin() + total_samples);
+
+    // piece r of the block is the keys in (splitter r - 1, splitter r]
+    std::vector<int> send_counts(np), send_displacements(np);
+    int cut = 0;
+    for (int r = 0; r < np; r++) {
+        int end = count;
+        if (r < np - 1 && total_samples > 0) {
+            int splitter = all_samples[(long)(r + 1) * total_samples / np];
+            end = std::upper_bound(data + cut, data + count, splitter) - data;
+        }
+        send_displacements[r] = cut;
+        send_counts[r] = end - cut;
+        cut = end;
+    }
+
+    std::vector<int> recv_counts(np), recv_displacements(np);
+    MPI_Alltoall(send_counts.data(), 1, MPI_INT, recv_counts.data(), 1, MPI_INT, comm);
+    int received = 0;
+    for (int r = 0; r < np; r++) {
+        recv_displacements[r] = received;
+        received += recv_counts[r];
+    }
+
+    int* bucket = (int*)malloc(std::max(received, 1) * sizeof(int));
+    int* scratch = (int*)malloc(std::max(received, 1) * sizeof(int));
+    if (bucket == NULL || scratch == NULL) {
+        perror("Failed to allocate sample sort bucket. Exiting...\n");
+        exit(1);
+    }
+
+    MPI_Alltoallv(data, send_counts.data(), send_displacements.data(), MPI_INT,
+                  bucket, recv_counts.data(), recv_displacements.data(), MPI_INT, comm);
+    times->exchange = sample_sort_seconds(start);
+
+    start = std::chrono::high_resolution_clock::now();
+    std::vector<long> bounds;
+    for (int r = 0; r < np; r++)
+        if (recv_counts[r] > 0) bounds.push_back(recv_displacements[r]);
+    bounds.push_back(received);
+
+    kway_merge(bucket, bounds, scratch, kway_merge_threads());
+    free(bucket);
+    times->merge = sample_sort_seconds(start);
+
+    *bucket_count = received;
+    return scratch;
+}
+
+// the gather-to-root alternative: every rank sorts its block data[0, counts[rank]),
+// the blocks are gathered on the root at displacements and k-way merged there.
+// the root's bucket is the whole sorted array, the other ranks' are empty.
+static inline int* gather_merge_sort(int* data, const int* counts, const int* displacements,
+                                     void (*local_sort)(int*, int, int), MPI_Comm comm,
+                                     int* bucket_count, sample_sort_times* times) {
+
+    int np, rank;
+    MPI_Comm_size(comm, &np);
+    MPI_Comm_rank(comm, &rank);
+    int count = counts[rank];
+
+    std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+    if (count > 1) local_sort(data, 0, count - 1);
+    times->local_sort = sample_sort_seconds(start);
+
+    // the root's block is already in place at its displacement
+    start = std::chrono::high_resolution_clock::now();
+    MPI_Gatherv(rank == 0 ? MPI_IN_PLACE : data, count, MPI_INT, data, counts, displacements, MPI_INT, 0, comm);
+    times->exchange = sample_sort_seconds(start);
+
+    start = std::chrono::high_resolution_clock::now();
+    long total = 0;
+    std::vector<long> bounds;
+    for (int r = 0; r < np; r++) {
+        if (counts[r] > 0) bounds.push_back(displacements[r]);
+        total += counts[r];
+    }
+    bounds.push_back(total);
+
+    *bucket_count = rank == 0 ? total : 0;
+    int* sorted = (int*)malloc(std::max(*bucket_count, 1) * sizeof(int));
+    if (sorted == NULL) {
+        perror("Failed to allocate merge output. Exiting...\n");
+        exit(1);
+    }
+    if (rank == 0) kway_merge(data, bounds, sorted, kway_merge_threads());
+    times->merge = sample_sort_seconds(start);
+
+    return sorted;
+}
+
+// check the distributed result: every bucket sorted, every non-empty bucket
+// starting no lower than the previous non-empty one ends, total keys in all,
+// and the buckets' multiset hashes summing to input_hash, the hash of the
+// unsorted input (needed on the root only). the same answer is returned on
+// every rank.
+static inline bool sample_sort_verify(const int* bucket, int count, long total, uint64_t input_hash, MPI_Comm comm) {
+
+    int np, rank;
+    MPI_Comm_size(comm, &np);
+    MPI_Comm_rank(comm, &rank);
+
+    int threads = sort_verify_threads();
+    uint64_t hash, output_hash = 0;
+    int ok = sort_scan(bucket, count, threads, &hash) == 0;
+
+    MPI_Reduce(&hash, &output_hash, 1, MPI_UINT64_T, MPI_SUM, 0, comm);
+    if (rank == 0 && output_hash != input_hash) ok = 0;
+
+    // count, first and last key of every rank
+    int mine[3] = {count, count > 0 ? bucket[0] : 0, count > 0 ? bucket[count - 1] : 0};
+    std::vector<int> edges(3 * np);
+    MPI_Allgather(mine, 3, MPI_INT, edges.data(), 3, MPI_INT, comm);
+
+    long keys = 0;
+    bool seen = false;
+    int last = 0;
+    for (int r = 0; r < np; r++) {
+        keys += edges[3 * r];
+        if (edges[3 * r] == 0) continue;
+        if (seen && edges[3 * r + 1] < last) ok = 0;
+        last = edges[3 * r + 2];
+        seen = true;
+    }
+    if (keys != total) ok = 0;
+
+    int all_ok;
+    MPI_Allreduce(&ok, &all_ok, 1, MPI_INT, MPI_LAND, comm);
+    return all_ok != 0;
+}
+
+#endif
@@ -0,0 +1,70 @@
+#ifndef SORT_VERIFY_H
+#define SORT_VERIFY_H
+
+#include <stdint.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+// Whole-array checks for the sort benchmarks, cheap enough to leave on.
+//
+// The permutation check is an order-independent multiset hash: the sum of
+// sort_key_hash() over every key. a sort must leave it unchanged, so summing
+// it while the input is generated and again over the output catches lost,
+// duplicated or corrupted keys. being a sum, hashes of pieces (threads,
+// ranks) simply add up.
+//
+// sort_scan() hashes the output and counts i with a[i] > a[i + 1] in the same
+// pass. each thread takes a contiguous chunk and starts from the key before
+// it, so the pairs across chunk boundaries are covered too. the mix is one
+// multiply and a shift so that the pass stays memory bound.
+
+static inline uint64_t sort_key_hash(int key) {
+
+    uint64_t z = ((uint64_t)(uint32_t)key + 0x9e3779b97f4a7c15ull) * 0xbf58476d1ce4e5b9ull;
+    return z ^ (z >> 29);
+}
+
+// unsorted adjacent pairs of a[0, n), and its multiset hash in *hash
+static inline long sort_scan(const int* a, long n, int threads, uint64_t* hash) {
+
+    long bad = 0;
+    uint64_t h = 0;
+#ifdef _OPENMP
+    #pragma omp parallel for num_threads(threads) schedule(static, 1) reduction(+:bad, h)
+#endif
+    for (int t = 0; t < threads; t++) {
+        long first = n * t / threads, last = n * (t + 1) / threads;
+        if (first == last) continue;
+
+        int prev = a[first > 0 ? first - 1 : 0];
+        for (long i = first; i < last; i++) {
+            int key = a[i];
+            bad += prev > key;
+            prev = key;
+            h += sort_key_hash(key);
+        }
+    }
+
+    *hash = h;
+    return bad;
+}
+
+// sorted and a permutation of the input whose hash was input_hash
+static inline bool sort_verify(const int* a, long n, uint64_t input_hash, int threads) {
+
+    uint64_t hash;
+    long bad = sort_scan(a, n, threads, &hash);
+    return bad == 0 && hash == input_hash;
+}
+
+// threads for the checks, the openmp default when built with it
+static inline int sort_verify_threads() {
+#ifdef _OPENMP
+    return omp_get_max_threads();
+#else
+    return 1;
+#endif
+}
+
+#endif
@@ -0,0 +1,234 @@
+#ifndef STRASSEN_H
+#define STRASSEN_H
+
+#include <string.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#include "matrix.h"
+#include "gemm.h"
+
+// sub-problems with any dimension at or below the crossover use the blocked gemm
+#define STRASSEN_CROSSOVER 512
+
+// recursion depth down to which the seven products are spawned as omp tasks,
+// 7^3 = 343 tasks is enough to keep any node busy without drowning in overhead
+#define STRASSEN_TASK_DEPTH 3
+
+// row-major block inside a larger matrix
+template <class T>
+struct strassen_view {
+    T* p;
+    int ld;
+
+    T* row(int r) const { return p + (size_t)r * ld; }
+
+    // quadrant (qr, qc) of a block whose quadrants are rows x cols
+    strassen_view quad(int qr, int qc, int rows, int cols) const {
+        strassen_view v = {p + (size_t)qr * rows * ld + (size_t)qc * cols, ld};
+        return v;
+    }
+};
+
+template <class T>
+static inline strassen_view<T> strassen_wrap(Matrix<T> &m) {
+    strassen_view<T> v = {m.data(), m.stride()};
+    return v;
+}
+
+// z = x + y
+template <class T>
+static inline void strassen_add(int rows, int cols, strassen_view<T> x, strassen_view<T> y, strassen_view<T> z) {
+
+    for (int r = 0; r < rows; r++) {
+        const T* xr = x.row(r);
+        const T* yr = y.row(r);
+        T* zr = z.row(r);
+        for (int c = 0; c < cols; c++) zr[c] = xr[c] + yr[c];
+    }
+}
+
+// z = x - y
+template <class T>
+static inline void strassen_sub(int rows, int cols, strassen_view<T> x, strassen_view<T> y, strassen_view<T> z) {
+
+    for (int r = 0; r < rows; r++) {
+        const T* xr = x.row(r);
+        const T* yr = y.row(r);
+        T* zr = z.row(r);
+        for (int c = 0; c < cols; c++) zr[c] = xr[c] - yr[c];
+    }
+}
+
+// c = a * b for an m x k by k x n product, every dimension divisible by 2^levels.
+// strassen-winograd form: 7 half-size products and 15 additions per level.
+template <class T>
+static void strassen_rec(int m, int k, int n, strassen_view<T> a, strassen_view<T> b, strassen_view<T> c,
+                         int levels, int depth) {
+
+    if (levels == 0) {
+        for (int r = 0; r < m; r++) memset(c.row(r), 0, n * sizeof(T));
+        gemm_tile(a.p, a.ld, b.p, b.ld, c.p, c.ld, k, 0, m, 0, n);
+        return;
+    }
+
+    int m2 = m / 2, k2 = k / 2, n2 = n / 2;
+
+    strassen_view<T> a11 = a.quad(0, 0, m2, k2), a12 = a.quad(0, 1, m2, k2);
+    strassen_view<T> a21 = a.quad(1, 0, m2, k2), a22 = a.quad(1, 1, m2, k2);
+    strassen_view<T> b11 = b.quad(0, 0, k2, n2), b12 = b.quad(0, 1, k2, n2);
+    strassen_view<T> b21 = b.quad(1, 0, k2, n2), b22 = b.quad(1, 1, k2, n2);
+    strassen_view<T> c11 = c.quad(0, 0, m2, n2), c12 = c.quad(0, 1, m2, n2);
+    strassen_view<T> c21 = c.quad(1, 0, m2, n2), c22 = c.quad(1, 1, m2, n2);
+
+    Matrix<T> s1m(m2, k2), s2m(m2, k2), s3m(m2, k2), s4m(m2, k2);
+    Matrix<T> t1m(k2, n2), t2m(k2, n2), t3m(k2, n2), t4m(k2, n2);
+    Matrix<T> p2m(m2, n2), p6m(m2, n2), p7m(m2, n2);
+
+    strassen_view<T> s1 = strassen_wrap(s1m), s2 = strassen_wrap(s2m), s3 = strassen_wrap(s3m), s4 = strassen_wrap(s4m);
+    strassen_view<T> t1 = strassen_wrap(t1m), t2 = strassen_wrap(t2m), t3 = strassen_wrap(t3m), t4 = strassen_wrap(t4m);
+    strassen_view<T> p2 = strassen_wrap(p2m), p6 = strassen_wrap(p6m), p7 = strassen_wrap(p7m);
+
+    strassen_add(m2, k2, a21, a22, s1);
+    strassen_sub(m2, k2, s1, a11, s2);
+    strassen_sub(m2, k2, a11, a21, s3);
+    strassen_sub(m2, k2, a12, s2, s4);
+
+    strassen_sub(k2, n2, b12, b11, t1);
+    strassen_sub(k2, n2, b22, t1, t2);
+    strassen_sub(k2, n2, b22, b12, t3);
+    strassen_sub(k2, n2, t2, b21, t4);
+
+    // p1, p3, p4 and p5 are written straight into the quadrants of c they feed
+#ifdef _OPENMP
+    bool spawn = depth < STRASSEN_TASK_DEPTH;
+#endif
+
+#ifdef _OPENMP
+    #pragma omp task if(spawn)
+#endif
+    strassen_rec(m2, k2, n2, a11, b11, c11, levels - 1, depth + 1);     // p1
+#ifdef _OPENMP
+    #pragma omp task if(spawn)
+#endif
+    strassen_rec(m2, k2, n2, a12, b21, p2, levels - 1, depth + 1);      // p2
+#ifdef _OPENMP
+    #pragma omp task if(spawn)
+#endif
+    strassen_rec(m2, k2, n2, s4, b22, c12, levels - 1, depth + 1);      // p3
+#ifdef _OPENMP
+    #pragma omp task if(spawn)
+#endif
+    strassen_rec(m2, k2, n2, a22, t4, c21, levels - 1, depth + 1);      // p4
+#ifdef _OPENMP
+    #pragma omp task if(spawn)
+#endif
+    strassen_rec(m2, k2, n2, s1, t1, c22, levels - 1, depth + 1);       // p5
+#ifdef _OPENMP
+    #pragma omp task if(spawn)
+#endif
+    strassen_rec(m2, k2, n2, s2, t2, p6, levels - 1, depth + 1);        // p6
+#ifdef _OPENMP
+    #pragma omp task if(spawn)
+#endif
+    strassen_rec(m2, k2, n2, s3, t3, p7, levels - 1, depth + 1);        // p7
+#ifdef _OPENMP
+    #pragma omp taskwait
+#endif
+
+    strassen_add(m2, n2, c11, p6, p6);      // u2 = p1 + p6
+    strassen_add(m2, n2, c11, p2, c11);     // c11 = u1 = p1 + p2
+    strassen_add(m2, n2, p6, p7, p7);       // u3 = u2 + p7
+    strassen_add(m2, n2, p6, c22, p6);      // u4 = u2 + p5
+    strassen_add(m2, n2, p6, c12, c12);     // c12 = u5 = u4 + p3
+    strassen_sub(m2, n2, p7, c21, c21);     // c21 = u6 = u3 - p4
+    strassen_add(m2, n2, p7, c22, c22);     // c22 = u7 = u3 + p5
+}
+
+// recursion levels before the smallest dimension reaches the crossover
+static inline int strassen_levels(int m, int k, int n, int crossover) {
+
+    int d = m < k ? m : k;
+    d = d < n ? d : n;
+
+    int levels = 0;
+    while (d > crossover && crossover > 0) {
+        d = (d + 1) / 2;
+        levels++;
+    }
+    return levels;
+}
+
+static inline int strassen_round_up(int x, int unit) {
+    return (x + unit - 1) / unit * unit;
+}
+
+// copy rows x cols of src into the top-left of a zeroed padded x padded_cols matrix
+template <class T>
+static inline Matrix<T> strassen_pad(const T* src, int ld, int rows, int cols, int padded_rows, int padded_cols) {
+
+    Matrix<T> m(padded_rows, padded_cols);
+    m.fill(0);
+    for (int r = 0; r < rows; r++) memcpy(m[r], &src[(size_t)r * ld], cols * sizeof(T));
+    return m;
+}
+
+// c = a * b (c is overwritten) for an m x k by k x n product. dimensions are
+// zero padded up to a multiple of 2^levels, so any size is accepted. the
+// recursion runs as omp tasks, opening a parallel region if not already in one.
+template <class T>
+static inline void strassen(const T* a, int lda, const T* b, int ldb, T* c, int ldc,
+                            int m, int k, int n, int crossover) {
+
+    int levels = strassen_levels(m, k, n, crossover);
+    int unit = 1 << levels;
+    int pm = strassen_round_up(m, unit), pk = strassen_round_up(k, unit), pn = strassen_round_up(n, unit);
+
+    Matrix<T> pa, pb, pc;
+    strassen_view<T> va = {(T*)a, lda}, vb = {(T*)b, ldb}, vc = {c, ldc};
+
+    if (pm != m || pk != k) {
+        pa = strassen_pad(a, lda, m, k, pm, pk);
+        va = strassen_wrap(pa);
+    }
+    if (pk != k || pn != n) {
+        pb = strassen_pad(b, ldb, k, n, pk, pn);
+        vb = strassen_wrap(pb);
+    }
+    if (pm != m || pn != n) {
+        pc = Matrix<T>(pm, pn);
+        vc = strassen_wrap(pc);
+    }
+
+#ifdef _OPENMP
+    if (!omp_in_parallel()) {
+        #pragma omp parallel
+        #pragma omp single
+        strassen_rec(pm, pk, pn, va, vb, vc, levels, 0);
+    }
+    else
+#endif
+    {
+        strassen_rec(pm, pk, pn, va, vb, vc, levels, 0);
+    }
+
+    if (vc.p != c) {
+        for (int r = 0; r < m; r++) memcpy(&c[(size_t)r * ldc], pc[r], n * sizeof(T));
+    }
+}
+
+// c[row_start..row_end) = a[row_start..row_end) * b
+template <class T>
+static inline void strassen_rows(const Matrix<T> &a, const Matrix<T> &b, Matrix<T> &c,
+                                 int row_start, int row_end, int crossover) {
+    strassen(a[row_start], a.stride(), b.data(), b.stride(), c[row_start], c.stride(),
+             row_end - row_start, a.cols(), b.cols(), crossover);
+}
+
+// c = a * b
+template <class T>
+static inline void strassen(const Matrix<T> &a, const Matrix<T> &b, Matrix<T> &c, int crossover) {
+    strassen_rows(a, b, c, 0, a.rows(), crossover);
+}
+
+#endif
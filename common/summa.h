@@ -0,0 +1,210 @@
+#ifndef SUMMA_H
+#define SUMMA_H
+
+#include <mpi.h>
+#include <string.h>
+#include <vector>
+#include "matrix.h"
+#include "matrix_mpi.h"
+#include "gemm.h"
+
+// SUMMA on a 2d process grid. a, b and c are split into grid.rows x grid.cols
+// blocks and every rank holds one block of each, so per-rank memory is
+// O(n^2 / np) and nothing is replicated. for each k panel, the grid column
+// owning those columns of a broadcasts them along grid rows, the grid row
+// owning those rows of b broadcasts them along grid columns, and every rank
+// accumulates c_block += a_panel * b_panel. panels are double buffered: the
+// broadcasts for panel s + 1 are posted before panel s is multiplied.
+//
+// Blocks are contiguous, not block-cyclic. Cyclic ownership balances
+// factorisations, where the active part of the matrix shrinks as k advances;
+// in a product every rank multiplies its whole c block by every panel, so the
+// work per step is the same on every rank either way, and only the ranks
+// broadcasting each panel change. Contiguous blocks keep a rank's rows and
+// columns a single range, which the generation, checksum and gather rely on.
+
+// default panel width, k columns of a / rows of b per broadcast step
+#define SUMMA_PANEL 256
+
+struct summa_grid {
+    MPI_Comm comm;          // 2d cartesian communicator
+    MPI_Comm row_comm;      // my grid row, ranked by grid column
+    MPI_Comm col_comm;      // my grid column, ranked by grid row
+    int rows, cols;         // grid shape
+    int row, col;           // my coordinates
+};
+
+// most square grid for the ranks in comm
+static inline summa_grid summa_grid_create(MPI_Comm comm) {
+
+    summa_grid grid;
+    int np, rank;
+    MPI_Comm_size(comm, &np);
+
+    int dims[2] = {0, 0};
+    int periods[2] = {0, 0};
+    MPI_Dims_create(np, 2, dims);
+    MPI_Cart_create(comm, 2, dims, periods, 0, &grid.comm);
+
+    int coords[2];
+    MPI_Comm_rank(grid.comm, &rank);
+    MPI_Cart_coords(grid.comm, rank, 2, coords);
+    grid.rows = dims[0];
+    grid.cols = dims[1];
+    grid.row = coords[0];
+    grid.col = coords[1];
+
+    int keep_cols[2] = {0, 1};
+    int keep_rows[2] = {1, 0};
+    MPI_Cart_sub(grid.comm, keep_cols, &grid.row_comm);
+    MPI_Cart_sub(grid.comm, keep_rows, &grid.col_comm);
+
+    return grid;
+}
+
+static inline void summa_grid_free(summa_grid* grid) {
+
+    MPI_Comm_free(&grid->row_comm);
+    MPI_Comm_free(&grid->col_comm);
+    MPI_Comm_free(&grid->comm);
+}
+
+// n split into parts near-equal blocks, the first n % parts one larger
+static inline int summa_block_start(int n, int parts, int index) {
+
+    int base = n / parts, rem = n % parts;
+    return index * base + (index < rem ? index : rem);
+}
+
+static inline int summa_block_size(int n, int parts, int index) {
+    return n / parts + (index < n % parts ? 1 : 0);
+}
+
+// block holding element i
+static inline int summa_block_owner(int n, int parts, int i) {
+
+    int base = n / parts, rem = n % parts;
+    int big = rem * (base + 1);
+    return i < big ? i / (base + 1) : rem + (i - big) / base;
+}
+
+// c += a * b on local panels, all row-major with the given leading dimensions
+template <class T>
+using summa_kernel_t = void (*)(const T* a, int lda, const T* b, int ldb, T* c, int ldc, int m, int k, int n, void* ctx);
+
+template <class T>
+static inline void summa_gemm_kernel(const T* a, int lda, const T* b, int ldb, T* c, int ldc, int m, int k, int n, void*) {
+    gemm_tile(a, lda, b, ldb, c, ldc, k, 0, m, 0, n);
+}
+
+// seconds this rank spent waiting on panel broadcasts and multiplying panels
+struct summa_times {
+    double wait;
+    double compute;
+};
+
+// c += a * b for an m x k by k x n product. this rank holds block (grid.row,
+// grid.col) of each: a is rows [block of m over grid.rows] x cols [block of k
+// over grid.cols], b is rows [block of k over grid.rows] x cols [block of n
+// over grid.cols], c is rows [block of m] x cols [block of n].
+template <class T>
+static inline void summa(const summa_grid &grid, int m, int k, int n, const Matrix<T> &a, const Matrix<T> &b,
+                         Matrix<T> &c, int panel, summa_kernel_t<T> kernel, void* ctx, summa_times* times) {
+
+    // this rank's block of the m x n product, the shape of c
+    int my_rows = summa_block_size(m, grid.rows, grid.row);
+    int my_cols = summa_block_size(n, grid.cols, grid.col);
+    MPI_Datatype type = matrix_mpi_type<T>();
+
+    // panels never straddle a block boundary of a's columns or b's rows, so
+    // each has a single owner in the grid row and in the grid column
+    struct step_t {
+        int k0, kb, a_owner, b_owner;
+    };
+    std::vector<step_t> steps;
+    for (int k0 = 0; k0 < k; ) {
+        step_t s = {k0, 0, summa_block_owner(k, grid.cols, k0), summa_block_owner(k, grid.rows, k0)};
+        int a_end = summa_block_start(k, grid.cols, s.a_owner) + summa_block_size(k, grid.cols, s.a_owner);
+        int b_end = summa_block_start(k, grid.rows, s.b_owner) + summa_block_size(k, grid.rows, s.b_owner);
+        s.kb = gemm_min(panel, gemm_min(a_end, b_end) - k0);
+        steps.push_back(s);
+        k0 += s.kb;
+    }
+
+    Matrix<T> a_panel[2] = {Matrix<T>(my_rows, panel), Matrix<T>(my_rows, panel)};
+    Matrix<T> b_panel[2] = {Matrix<T>(panel, my_cols), Matrix<T>(panel, my_cols)};
+    MPI_Request requests[2][2];
+
+    // owners pack their part of the panel (kb wide, so ld = kb) then every rank joins the broadcasts
+    auto post = [&](int s, int buf) {
+        const step_t &st = steps[s];
+        T* ap = a_panel[buf].data();
+        T* bp = b_panel[buf].data();
+
+        if (grid.col == st.a_owner) {
+            int col = st.k0 - summa_block_start(k, grid.cols, grid.col);
+            for (int r = 0; r < my_rows; r++)
+                memcpy(&ap[(size_t)r * st.kb], &a[r][col], st.kb * sizeof(T));
+        }
+        if (grid.row == st.b_owner) {
+            int row = st.k0 - summa_block_start(k, grid.rows, grid.row);
+            memcpy(bp, b[row], (size_t)st.kb * my_cols * sizeof(T));
+        }
+
+        MPI_Ibcast(ap, my_rows * st.kb, type, st.a_owner, grid.row_comm, &requests[buf][0]);
+        MPI_Ibcast(bp, st.kb * my_cols, type, st.b_owner, grid.col_comm, &requests[buf][1]);
+    };
+
+    times->wait = 0;
+    times->compute = 0;
+
+    if (!steps.empty()) post(0, 0);
+
+    for (size_t s = 0; s < steps.size(); s++) {
+        int buf = s % 2;
+
+        double t_wait = MPI_Wtime();
+        MPI_Waitall(2, requests[buf], MPI_STATUSES_IGNORE);
+        times->wait += MPI_Wtime() - t_wait;
+
+        // next panel is in flight while this one is multiplied
+        if (s + 1 < steps.size()) post(s + 1, 1 - buf);
+
+        double t_compute = MPI_Wtime();
+        int kb = steps[s].kb;
+        kernel(a_panel[buf].data(), kb, b_panel[buf].data(), my_cols, c.data(), c.stride(), my_rows, kb, my_cols, ctx);
+        times->compute += MPI_Wtime() - t_compute;
+    }
+}
+
+// assemble the full m x n c on rank 0 of grid.comm from every rank's block
+template <class T>
+static inline void summa_gather(const summa_grid &grid, int m, int n, const Matrix<T> &c, Matrix<T> &full) {
+
+    MPI_Datatype type = matrix_mpi_type<T>();
+    int rank, np;
+    MPI_Comm_rank(grid.comm, &rank);
+    MPI_Comm_size(grid.comm, &np);
+
+    if (rank != 0) {
+        MPI_Send(c.data(), c.count(), type, 0, 0, grid.comm);
+        return;
+    }
+
+    full = Matrix<T>(m, n);
+    for (int p = 0; p < np; p++) {
+        int coords[2];
+        MPI_Cart_coords(grid.comm, p, 2, coords);
+        int row0 = summa_block_start(m, grid.rows, coords[0]);
+        int col0 = summa_block_start(n, grid.cols, coords[1]);
+        Matrix<T> block(summa_block_size(m, grid.rows, coords[0]), summa_block_size(n, grid.cols, coords[1]));
+
+        if (p == 0) memcpy(block.data(), c.data(), c.bytes());
+        else MPI_Recv(block.data(), block.count(), type, p, 0, grid.comm, MPI_STATUS_IGNORE);
+
+        for (int r = 0; r < block.rows(); r++)
+            memcpy(&full[row0 + r][col0], block[r], block.cols() * sizeof(T));
+    }
+}
+
+#endif
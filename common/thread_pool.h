@@ -0,0 +1,240 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <pthread.h>
+#include <time.h>
+#include <vector>
+#include <deque>
+
+// 2d block of output, rows [row_start, row_end) x cols [col_start, col_end)
+struct tile_t {
+    int row_start, row_end, col_start, col_end;
+};
+
+// per worker counters, accumulated over every run() since the last reset_stats()
+struct worker_stats_t {
+    long tiles;         // tiles executed
+    long stolen;        // of those, tiles taken from another worker's queue
+    double busy;        // seconds spent executing tiles
+};
+
+// split a rows x cols output into tiles of at most tile_rows x tile_cols
+static inline std::vector<tile_t> make_tiles(int rows, int cols, int tile_rows, int tile_cols) {
+
+    std::vector<tile_t> tiles;
+    for (int r = 0; r < rows; r += tile_rows)
+    for (int c = 0; c < cols; c += tile_cols) {
+        tile_t t = {r, r + tile_rows < rows ? r + tile_rows : rows,
+                    c, c + tile_cols < cols ? c + tile_cols : cols};
+        tiles.push_back(t);
+    }
+    return tiles;
+}
+
+// persistent pthread pool. each run() deals tiles out to per-worker queues,
+// workers drain their own queue from the back and steal from the front of
+// other queues once theirs is empty. threads live until the pool is destroyed.
+class thread_pool {
+public:
+    typedef void (*tile_fn)(const tile_t &tile, void* ctx);
+
+    explicit thread_pool(int threads):
+        _threads(threads),
+        _queues(threads),
+        _stats(threads),
+        _fn(NULL),
+        _ctx(NULL),
+        _generation(0),
+        _remaining(0),
+        _wall(0),
+        _shutdown(false)
+    {
+        pthread_mutex_init(&_lock, NULL);
+        pthread_cond_init(&_start, NULL);
+        pthread_cond_init(&_done, NULL);
+
+        _queue_locks = new pthread_mutex_t[threads];
+        for (int t = 0; t < threads; t++)
+            pthread_mutex_init(&_queue_locks[t], NULL);
+
+        reset_stats();
+
+        _workers = new pthread_t[threads];
+        _args = new worker_arg[threads];
+        for (int t = 0; t < threads; t++) {
+            _args[t].pool = this;
+            _args[t].id = t;
+            pthread_create(&_workers[t], NULL, &thread_pool::_worker, &_args[t]);
+        }
+    }
+
+    ~thread_pool()
+    {
+        pthread_mutex_lock(&_lock);
+        _shutdown = true;
+        pthread_cond_broadcast(&_start);
+        pthread_mutex_unlock(&_lock);
+
+        for (int t = 0; t < _threads; t++)
+            pthread_join(_workers[t], NULL);
+
+        for (int t = 0; t < _threads; t++)
+            pthread_mutex_destroy(&_queue_locks[t]);
+        pthread_mutex_destroy(&_lock);
+        pthread_cond_destroy(&_start);
+        pthread_cond_destroy(&_done);
+
+        delete [] _queue_locks;
+        delete [] _workers;
+        delete [] _args;
+    }
+
+    thread_pool(const thread_pool&) = delete;
+    thread_pool& operator=(const thread_pool&) = delete;
+
+    // run fn over every tile and block until all have finished
+    void run(const std::vector<tile_t> &tiles, tile_fn fn, void* ctx) {
+
+        if (tiles.empty()) return;
+
+        // deal contiguous runs of tiles to each worker so neighbouring tiles,
+        // which share panels of a and b, start on the same thread
+        int per_worker = (tiles.size() + _threads - 1) / _threads;
+        for (int t = 0; t < _threads; t++) {
+            pthread_mutex_lock(&_queue_locks[t]);
+            _queues[t].clear();
+            for (size_t i = t * per_worker; i < tiles.size() && i < (size_t)(t + 1) * per_worker; i++)
+                _queues[t].push_back(tiles[i]);
+            pthread_mutex_unlock(&_queue_locks[t]);
+        }
+
+        double start = _now();
+
+        pthread_mutex_lock(&_lock);
+        _fn = fn;
+        _ctx = ctx;
+        _remaining = _threads;
+        _generation++;
+        pthread_cond_broadcast(&_start);
+        while (_remaining > 0)
+            pthread_cond_wait(&_done, &_lock);
+        pthread_mutex_unlock(&_lock);
+
+        _wall += _now() - start;
+    }
+
+    void reset_stats() {
+
+        for (int t = 0; t < _threads; t++) {
+            _stats[t].tiles = 0;
+            _stats[t].stolen = 0;
+            _stats[t].busy = 0;
+        }
+        _wall = 0;
+    }
+
+    int size() const { return _threads; }
+    const worker_stats_t& stats(int worker) const { return _stats[worker]; }
+
+    // wall clock seconds spent inside run() since the last reset_stats()
+    double wall() const { return _wall; }
+
+private:
+    struct worker_arg {
+        thread_pool* pool;
+        int id;
+    };
+
+    int _threads;
+    pthread_t* _workers;
+    worker_arg* _args;
+    std::vector<std::deque<tile_t>> _queues;
+    pthread_mutex_t* _queue_locks;
+    std::vector<worker_stats_t> _stats;
+
+    tile_fn _fn;
+    void* _ctx;
+    long _generation;
+    int _remaining;
+    double _wall;
+    bool _shutdown;
+    pthread_mutex_t _lock;
+    pthread_cond_t _start;
+    pthread_cond_t _done;
+
+    static double _now() {
+
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec + ts.tv_nsec * 1e-9;
+    }
+
+    // own queue from the back, then other queues from the front
+    bool _next_tile(int id, tile_t* tile, bool* stolen) {
+
+        for (int i = 0; i < _threads; i++) {
+            int q = (id + i) % _threads;
+            pthread_mutex_lock(&_queue_locks[q]);
+            bool found = !_queues[q].empty();
+            if (found) {
+                if (i == 0) {
+                    *tile = _queues[q].back();
+                    _queues[q].pop_back();
+                }
+                else {
+                    *tile = _queues[q].front();
+                    _queues[q].pop_front();
+                }
+            }
+            pthread_mutex_unlock(&_queue_locks[q]);
+
+            if (found) {
+                *stolen = (i != 0);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    static void* _worker(void* arg) {
+
+        thread_pool* pool = ((worker_arg*)arg)->pool;
+        int id = ((worker_arg*)arg)->id;
+        long seen = 0;
+
+        while (1) {
+            // wait for the next run() or shutdown
+            pthread_mutex_lock(&pool->_lock);
+            while (pool->_generation == seen && !pool->_shutdown)
+                pthread_cond_wait(&pool->_start, &pool->_lock);
+            if (pool->_shutdown) {
+                pthread_mutex_unlock(&pool->_lock);
+                break;
+            }
+            seen = pool->_generation;
+            tile_fn fn = pool->_fn;
+            void* ctx = pool->_ctx;
+            pthread_mutex_unlock(&pool->_lock);
+
+            tile_t tile;
+            bool stolen;
+            while (pool->_next_tile(id, &tile, &stolen)) {
+                double start = _now();
+                fn(tile, ctx);
+                pool->_stats[id].busy += _now() - start;
+                pool->_stats[id].tiles++;
+                if (stolen) pool->_stats[id].stolen++;
+            }
+
+            // last worker out wakes run()
+            pthread_mutex_lock(&pool->_lock);
+            if (--pool->_remaining == 0)
+                pthread_cond_signal(&pool->_done);
+            pthread_mutex_unlock(&pool->_lock);
+        }
+
+        return NULL;
+    }
+};
+
+#endif
@@ -0,0 +1,118 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include "../common/matrix_io.h"
+
+// Converts a binary matrix file (.mat) written by the matmul programs back
+// into the csv text they used to write: a "Title:" line followed by one
+// comma separated line per row. Checksums are verified while converting.
+//
+// usage: mm-convert [--list] <matrix file> [csv file]
+//   --list  only print the record headers
+//   without a csv file the text goes to stdout
+
+#define CONVERT_BUFFER (1 << 20)
+
+template <class T>
+void write_rows(FILE* out, const matrix_file_header* header, const T* data, const char* format) {
+
+    for (uint64_t r = 0; r < header->rows; r++) {
+        const T* row = &data[r * header->cols];
+        for (uint64_t c = 0; c < header->cols; c++) {
+            fprintf(out, format, row[c]);
+            fputc(c + 1 < header->cols ? ',' : '\n', out);
+        }
+    }
+}
+
+bool write_csv(FILE* out, const matrix_file_header* header, const void* data) {
+
+    if (matrix_dtype_size(header->dtype) == 0) return false;
+    fprintf(out, "%s:\n", header->title);
+
+    switch (header->dtype) {
+        case MATRIX_DTYPE_INT32: write_rows(out, header, (const int32_t*)data, "%" PRId32); break;
+        case MATRIX_DTYPE_INT64: write_rows(out, header, (const int64_t*)data, "%" PRId64); break;
+        case MATRIX_DTYPE_FLOAT32: write_rows(out, header, (const float*)data, "%.9g"); break;
+        case MATRIX_DTYPE_FLOAT64: write_rows(out, header, (const double*)data, "%.17g"); break;
+        default: return false;
+    }
+    return true;
+}
+
+int main(int argc, char** argv) {
+
+    bool list = false;
+    const char* in_name = NULL;
+    const char* out_name = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--list") == 0) list = true;
+        else if (in_name == NULL) in_name = argv[i];
+        else out_name = argv[i];
+    }
+
+    if (in_name == NULL) {
+        fprintf(stderr, "usage: %s [--list] <matrix file> [csv file]\n", argv[0]);
+        return 2;
+    }
+
+    matrix_file file;
+    if (!map_matrix_file(in_name, &file)) {
+        perror(in_name);
+        return 1;
+    }
+    if (!is_matrix_file(file)) {
+        fprintf(stderr, "%s: not a matrix file\n", in_name);
+        unmap_matrix_file(&file);
+        return 1;
+    }
+
+    FILE* out = stdout;
+    if (!list && out_name != NULL) {
+        out = fopen(out_name, "w");
+        if (out == NULL) {
+            perror(out_name);
+            unmap_matrix_file(&file);
+            return 1;
+        }
+    }
+    setvbuf(out, NULL, _IOFBF, CONVERT_BUFFER);
+
+    bool ok = true;
+    size_t offset = 0;
+    const void* data;
+    const matrix_file_header* header;
+
+    while ((header = next_matrix_record(file, &offset, &data)) != NULL) {
+        bool valid = matrix_record_valid(header, data);
+        if (!valid) ok = false;
+
+        if (list) {
+            fprintf(out, "%-16s %8" PRIu64 " x %-8" PRIu64 " %-8s %016" PRIx64 " %s\n", header->title,
+                    header->rows, header->cols, matrix_dtype_name(header->dtype), header->checksum, valid ? "ok" : "BAD");
+            continue;
+        }
+
+        if (!valid) {
+            fprintf(stderr, "%s: %s has a bad checksum, skipped\n", in_name, header->title);
+            continue;
+        }
+        if (!write_csv(out, header, data)) {
+            fprintf(stderr, "%s: %s has unknown element type %u, skipped\n", in_name, header->title, header->dtype);
+            ok = false;
+        }
+    }
+
+    if (offset != file.size) {
+        fprintf(stderr, "%s: truncated or corrupt record at byte %zu\n", in_name, offset);
+        ok = false;
+    }
+
+    if (out != stdout) fclose(out);
+    else fflush(out);
+    unmap_matrix_file(&file);
+
+    return ok ? 0 : 1;
+}
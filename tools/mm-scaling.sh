@@ -0,0 +1,51 @@
+#!/bin/bash
+# Strong and weak scaling of the SUMMA mode of mm-mpi / mm-mpi-omp on one host.
+#
+# usage: mm-scaling.sh [program] [strong size] [weak size per rank]
+#   program             mm-mpi binary to run (default ./mm-mpi)
+#   strong size         n for the fixed-size runs (default 2400)
+#   weak size per rank  n at one rank, scaled by sqrt(np) so each rank keeps
+#                       the same block size (default 600)
+# NP="1 4 9 16" and MPIRUN="mpirun --oversubscribe" override the launcher.
+
+PROGRAM=${1:-./mm-mpi}
+STRONG=${2:-2400}
+WEAK=${3:-600}
+NP=${NP:-"1 4 9 16"}
+MPIRUN=${MPIRUN:-"mpirun --oversubscribe"}
+
+# elapsed seconds of one run
+run() {
+    $MPIRUN -np "$1" "$PROGRAM" "$2" --summa --seed 1 | awk -F'\t' '/^Elapsed Time:/ { print $2 }'
+}
+
+table() {
+    local mode=$1 base="" n t gflops
+    printf "%s scaling (%s)\n" "$mode" "$PROGRAM"
+    printf "%4s %8s %12s %10s %11s\n" "np" "n" "Elapsed (s)" "GFLOP/s" "Efficiency"
+
+    for np in $NP; do
+        if [ "$mode" = "Strong" ]; then
+            n=$STRONG
+        else
+            n=$(awk -v w="$WEAK" -v p="$np" 'BEGIN { printf "%d", w * sqrt(p) + 0.5 }')
+        fi
+
+        t=$(run "$np" "$n")
+        if [ -z "$t" ]; then
+            printf "%4d %8d %12s\n" "$np" "$n" "failed"
+            continue
+        fi
+        gflops=$(awk -v n="$n" -v t="$t" 'BEGIN { printf "%.6f", 2 * n * n * n / t / 1e9 }')
+        [ -z "$base" ] && base=$gflops
+
+        # throughput per rank relative to the first run, t1 / (np * tp) for strong scaling
+        awk -v np="$np" -v n="$n" -v t="$t" -v g="$gflops" -v base="$base" 'BEGIN {
+            printf "%4d %8d %12.4f %10.2f %10.1f%%\n", np, n, t, g, 100 * g / np / base
+        }'
+    done
+    echo
+}
+
+table Strong
+table Weak
@@ -0,0 +1,196 @@
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include "../common/matrix.h"
+#include "../common/matrix_io.h"
+#include "../common/gemm.h"
+
+using namespace std;
+
+// Recomputes every product in matmul result files (Task2.1P *.mat, Module3
+// mm-mpi*_result.mat, or csv text from mm-convert) with each gemm kernel this
+// cpu supports and checks the output is bit-exact against the stored product.
+// Files written with --no-inputs hold no a and b, so there is nothing to check.
+//
+// usage: mm-verify <result file> [result file...]
+
+struct csv_matrix {
+    string title;
+    vector<vector<elem_t>> rows;
+};
+
+bool is_csv_row(const string &line) {
+    return !line.empty() && (isdigit((unsigned char)line[0]) || line[0] == '-');
+}
+
+vector<elem_t> parse_row(const string &line) {
+
+    vector<elem_t> row;
+    const char* p = line.c_str();
+    char* end;
+    while (*p) {
+        row.push_back((elem_t)strtod(p, &end));
+        if (end == p) break;
+        p = (*end == ',') ? end + 1 : end;
+    }
+    return row;
+}
+
+// read every "Title:" header followed by csv rows
+vector<csv_matrix> read_matrices(const char* filename) {
+
+    vector<csv_matrix> matrices;
+    ifstream fin(filename);
+    string line;
+
+    while (getline(fin, line)) {
+        if (!line.empty() && line[line.size() - 1] == ':') {
+            // headers without csv rows (stats tables) are not matrices
+            if (!matrices.empty() && matrices.back().rows.empty()) matrices.pop_back();
+            csv_matrix m;
+            m.title = line.substr(0, line.size() - 1);
+            matrices.push_back(m);
+        }
+        else if (is_csv_row(line) && !matrices.empty()) {
+            matrices.back().rows.push_back(parse_row(line));
+        }
+    }
+
+    if (!matrices.empty() && matrices.back().rows.empty()) matrices.pop_back();
+    return matrices;
+}
+
+struct named_matrix {
+    string title;
+    Matrix<elem_t> m;
+};
+
+bool to_matrix(const csv_matrix &src, Matrix<elem_t> &dst) {
+
+    int rows = src.rows.size();
+    int cols = rows > 0 ? src.rows[0].size() : 0;
+    if (rows == 0 || cols == 0) return false;
+
+    dst = Matrix<elem_t>(rows, cols);
+    for (int r = 0; r < rows; r++) {
+        if ((int)src.rows[r].size() != cols) return false;
+        for (int c = 0; c < cols; c++) dst[r][c] = src.rows[r][c];
+    }
+    return true;
+}
+
+// every matrix in a binary .mat file or a csv text file. binary records
+// with a bad checksum or a different element type are skipped.
+vector<named_matrix> load_matrices(const char* filename) {
+
+    vector<named_matrix> loaded;
+    matrix_file file;
+
+    if (map_matrix_file(filename, &file) && is_matrix_file(file)) {
+        size_t offset = 0;
+        const void* data;
+        const matrix_file_header* header;
+        while ((header = next_matrix_record(file, &offset, &data)) != NULL) {
+            named_matrix nm;
+            nm.title = header->title;
+            if (!matrix_record_valid(header, data)) {
+                printf("%s: %s has a bad checksum, skipped\n", filename, header->title);
+                continue;
+            }
+            if (!read_matrix_record(header, data, nm.m)) {
+                printf("%s: %s is %s, not %s, skipped\n", filename, header->title,
+                       matrix_dtype_name(header->dtype), matrix_dtype_name(matrix_dtype<elem_t>()));
+                continue;
+            }
+            loaded.push_back(move(nm));
+        }
+        unmap_matrix_file(&file);
+        return loaded;
+    }
+    unmap_matrix_file(&file);
+
+    vector<csv_matrix> matrices = read_matrices(filename);
+    for (size_t i = 0; i < matrices.size(); i++) {
+        named_matrix nm;
+        nm.title = matrices[i].title;
+        if (to_matrix(matrices[i], nm.m)) loaded.push_back(move(nm));
+    }
+    return loaded;
+}
+
+// true if every kernel reproduces the stored product
+bool verify_product(const Matrix<elem_t> &a, const Matrix<elem_t> &b, const Matrix<elem_t> &expected) {
+
+    bool pass = true;
+
+    for (int isa = GEMM_ISA_SCALAR; isa <= gemm_cpu_isa; isa++) {
+        for (int narrow = 0; narrow <= (isa > GEMM_ISA_SCALAR ? 1 : 0); narrow++) {
+            gemm_set_isa(isa, narrow);
+
+            Matrix<elem_t> c(a.rows(), b.cols());
+            c.fill(0);
+            gemm(a, b, c);
+
+            bool match = (c == expected);
+            printf("  %-8s%-7s %s\n", gemm_isa_name(isa), narrow ? "+int16" : "", match ? "PASS" : "FAIL");
+            pass = pass && match;
+        }
+    }
+
+    gemm_set_isa(gemm_cpu_isa, true);
+    return pass;
+}
+
+int main(int argc, char** argv) {
+
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s <result file> [result file...]\n", argv[0]);
+        return 2;
+    }
+
+    printf("CPU kernel: %s\n", gemm_isa_name(gemm_cpu_isa));
+
+    bool pass = true;
+    int checked = 0;
+
+    for (int f = 1; f < argc; f++) {
+        vector<named_matrix> matrices = load_matrices(argv[f]);
+
+        // a product follows its "Matrix A" and "Matrix B" inputs
+        const Matrix<elem_t>* a = NULL;
+        const Matrix<elem_t>* b = NULL;
+        int products = 0;
+
+        for (size_t i = 0; i < matrices.size(); i++) {
+            if (matrices[i].title == "Matrix A") {
+                a = &matrices[i].m;
+                continue;
+            }
+            if (matrices[i].title == "Matrix B") {
+                b = &matrices[i].m;
+                continue;
+            }
+            if (a == NULL || b == NULL) continue;
+
+            const Matrix<elem_t> &expected = matrices[i].m;
+            printf("%s: product %d\n", argv[f], products++);
+
+            if (a->cols() != b->rows() || expected.rows() != a->rows() || expected.cols() != b->cols()) {
+                printf("  skipped, inconsistent matrix dimensions\n");
+            }
+            else {
+                printf("  %d x %d x %d\n", a->rows(), a->cols(), b->cols());
+                pass = verify_product(*a, *b, expected) && pass;
+                checked++;
+            }
+            a = b = NULL;
+        }
+    }
+
+    printf("%d products checked: %s\n", checked, pass ? "PASS" : "FAIL");
+    return pass ? 0 : 1;
+}